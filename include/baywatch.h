@@ -0,0 +1,22 @@
+#ifndef __SHELL_BUILTIN_BAYWATCH
+#define __SHELL_BUILTIN_BAYWATCH
+
+typedef struct bw_watch{
+	sampler s;
+	struct timespec interval;
+	int stopfd;
+	out_buffer out;
+	bool csv;
+	bool print;
+	bool recording;
+	bw_record rec;
+	string path;
+	pthread_t thread;
+	pid_t owner;
+} bw_watch;
+
+int baywatch(Command *c);
+bool baywatch_redirectable(Command *c);
+void baywatch_stop();
+
+#endif
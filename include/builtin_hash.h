@@ -0,0 +1,21 @@
+/**
+ * The hash of builtin names. Shared by the shell and gen_builtins, which picks
+ * the seed that makes it a perfect hash over the builtins at build time.
+ */
+
+#ifndef __SHELL_BUILTIN_HASH
+#define __SHELL_BUILTIN_HASH
+
+/**
+ * @brief FNV-1a over the name, starting from a seeded offset basis
+ */
+static inline uint32_t builtin_hash(const char *s, uint32_t seed){
+	uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+	for(; *s; s++){
+		h ^= (unsigned char) *s;
+		h *= 16777619u;
+	}
+	return h ^ (h >> 16);
+}
+
+#endif
@@ -2,19 +2,29 @@
 #define __SHELL_BUILTINS
 
 bool is_builtin(char *name);
+int builtin_id(const char *name);
 int exec_builtin(Command *c);
 int cd(Command *c);
 int pwd(Command *c);
 int echo(Command *c);
 int repeat(Command *c);
 int pinfo(Command *c);
+char pinfo_activity(const proc_stat *st, pid_t fg);
 int history(Command *c);
 int jobs(Command *c);
 int sig(Command *c);
 int bg(Command *c);
 int fg(Command *c);
 int replay(Command *c);
-int baywatch(Command *c);
+int idcache(Command *c);
+int lscache(Command *c);
+int procbench(Command *c);
+int every(Command *c);
+int at(Command *c);
+int timers(Command *c);
+int enable(Command *c);
+int zygote(Command *c);
+string rebuild_command(Command *c, int from);
 
 typedef struct job{
 	uint64_t job_num;
@@ -23,4 +33,27 @@ typedef struct job{
 	char status;
 } job;
 
+#define REPEAT_CODES 256
+#define REPEAT_SAMPLES 65536
+
+/**
+ * Aggregates of the iterations of repeat --stats. Wall times are in ns. Min, max and
+ * mean are exact, percentiles come from a uniform sample of at most REPEAT_SAMPLES
+ * of them (all of them for shorter runs). Deaths by signal N count as exit code 128 + N.
+ * Zero it to start, free wall when done.
+ */
+typedef struct repeat_stats{
+	int64_t *wall;
+	uint64_t n, kept, cap;
+	int64_t sum, min, max;
+	uint64_t rng;
+	bool rusage;
+	int64_t utime_us, stime_us;
+	uint64_t codes[REPEAT_CODES];
+} repeat_stats;
+
+int64_t repeat_now_ns();
+void repeat_record(repeat_stats *s, int64_t wall_ns, int code, struct rusage *ru);
+void repeat_print_stats(repeat_stats *s, int64_t total_ns, int64_t parallel);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef __SHELL_BUILTIN_DU
+#define __SHELL_BUILTIN_DU
+
+#define INODE_SHARDS 64
+
+typedef struct inode_key{
+	dev_t dev;
+	ino_t ino;
+} inode_key;
+
+typedef struct inode_shard{
+	inode_key *table;
+	uint32_t size;
+	uint32_t table_size;
+	pthread_mutex_t lock;
+} inode_shard;
+
+typedef struct inode_set{
+	inode_shard shards[INODE_SHARDS];
+} inode_set;
+
+// Hard linked files found in a directory, charged to it if it's the first to have them
+typedef struct inode_ref{
+	dev_t dev;
+	ino_t ino;
+	int64_t blocks;
+} inode_ref;
+
+typedef struct inode_list{
+	inode_ref *arr;
+	uint32_t size;
+	uint32_t table_size;
+} inode_list;
+
+int du(Command *c);
+
+#endif
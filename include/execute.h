@@ -3,6 +3,10 @@
 
 int execute(Command *c);
 int exec_pipe(Pipe *p);
+pid_t spawn_command(Command *c, pid_t pgid);
+pid_t fork_command(Command *c, pid_t pgid);
+int setup_redirection(Command *c);
+void cleanup_redirection();
 
 #define READ_END 0
 #define WRITE_END 1
@@ -0,0 +1,29 @@
+/**
+ * This is the code for a small uid/gid -> name cache. Looking up a name with
+ * getpwuid / getgrgid can hit nscd or the network, so every id is looked up 
+ * at most once per shell session (or until the cache is flushed).
+ */
+
+#ifndef __SHELL_IDCACHE
+#define __SHELL_IDCACHE
+
+typedef struct id_entry{
+	uint32_t id;
+	bool used;
+	string name;
+} id_entry;
+
+typedef struct id_cache{
+	id_entry *table;
+	uint32_t size;
+	uint32_t table_size;
+	uint64_t hits, misses;
+	pthread_mutex_t lock;
+} id_cache;
+
+void create_idcache(id_cache *c, uint32_t n);
+void destroy_idcache(id_cache *c);
+string uid_to_name(uid_t uid);
+string gid_to_name(gid_t gid);
+
+#endif
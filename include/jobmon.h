@@ -0,0 +1,28 @@
+#ifndef __SHELL_BUILTIN_JOBMON
+#define __SHELL_BUILTIN_JOBMON
+
+/**
+ * One sample of a tracked job. cpu is in tenths of a percent of one CPU,
+ * since the previous sample of the job or over its lifetime on the first.
+ */
+typedef struct job_stats{
+	uint64_t job_num;
+	pid_t pid;
+	string name;
+	char state;
+	int64_t cpu;
+	int64_t rss_kb;
+	int64_t read_bytes;
+	int64_t write_bytes;
+	int64_t threads;
+	launch_attr launch;
+} job_stats;
+
+uint32_t jobmon_sample(job_stats **stats);
+void jobmon_free(job_stats *stats, uint32_t n);
+void jobmon_print(out_buffer *out, job_stats *stats, uint32_t n);
+int jobmon_open(int *fd, pid_t pid, const char *file);
+void jobmon_close(Process *p);
+int jobtop(Command *c);
+
+#endif
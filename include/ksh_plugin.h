@@ -0,0 +1,84 @@
+/**
+ * This is the C ABI between ksh and builtin plugins. A plugin is a shared
+ * object exporting a `ksh_plugin` symbol of type ksh_plugin_info, listing the
+ * builtins it provides. `enable -f lib.so name...` loads it and adds the named
+ * builtins to the shell's dispatch, after which they run in-process like any
+ * other builtin: no fork, no exec.
+ *
+ * This header only depends on the C standard library, plugins include it on
+ * its own. A minimal plugin:
+ *
+ *     #include "ksh_plugin.h"
+ *
+ *     int hello(const ksh_plugin_call *call, const ksh_plugin_api *api){
+ *         for(int i = 1; i < call->argc && !api->cancelled(); i++)
+ *             api->printf("hello %s\n", call->argv[i]);
+ *         return 0;
+ *     }
+ *
+ *     static const ksh_builtin_def defs[] = {{"hello", hello, "greets its args"}, {NULL, NULL, NULL}};
+ *     const ksh_plugin_info ksh_plugin = {KSH_PLUGIN_ABI_VERSION, "hello", defs, NULL, NULL};
+ *
+ * Built with `cc -shared -fPIC -Iinclude hello.c -o hello.so`, loaded with
+ * `enable -f ./hello.so hello`.
+ */
+
+#ifndef __SHELL_KSH_PLUGIN
+#define __SHELL_KSH_PLUGIN
+
+#include<stddef.h>
+#include<stdint.h>
+
+// Bumped on any incompatible change to the structs below. Fields are only ever appended.
+#define KSH_PLUGIN_ABI_VERSION 1
+#define KSH_PLUGIN_SYMBOL "ksh_plugin"
+
+/**
+ * Services of the shell. Output goes through the shell's output buffer, which
+ * is flushed once the builtin returns (to wherever stdout was redirected).
+ * cancelled() turns nonzero when ctrl-c is pressed during the call, long
+ * running builtins should poll it and return early. size is sizeof the
+ * struct the shell was built with, fields past it don't exist.
+ */
+typedef struct ksh_plugin_api{
+	uint32_t abi_version;
+	uint32_t size;
+	int (*write)(const char *data, size_t len);
+	int (*printf)(const char *format, ...);
+	int (*flush)(void);
+	int (*cancelled)(void);
+} ksh_plugin_api;
+
+/**
+ * One invocation. argv[0] is the builtin name and argv[argc] is NULL. The fds
+ * are the builtin's stdin / stdout / stderr after redirection and pipes.
+ */
+typedef struct ksh_plugin_call{
+	int argc;
+	char **argv;
+	int in_fd, out_fd, err_fd;
+} ksh_plugin_call;
+
+// Returns the builtin's status, 0 on success
+typedef int (*ksh_builtin_fn)(const ksh_plugin_call *call, const ksh_plugin_api *api);
+
+typedef struct ksh_builtin_def{
+	const char *name;
+	ksh_builtin_fn fn;
+	const char *help;
+} ksh_builtin_def;
+
+/**
+ * What the `ksh_plugin` symbol holds. builtins ends with an entry whose name is
+ * NULL. init (optional) runs once when the library is loaded, a nonzero return
+ * refuses the load. fini (optional) runs before it is unloaded.
+ */
+typedef struct ksh_plugin_info{
+	uint32_t abi_version;
+	const char *name;
+	const ksh_builtin_def *builtins;
+	int (*init)(const ksh_plugin_api *api);
+	void (*fini)(void);
+} ksh_plugin_info;
+
+#endif
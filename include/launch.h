@@ -0,0 +1,51 @@
+/**
+ * This is the code for launch attributes: `@key=value` tokens in front of a
+ * command name that the child applies to itself between fork and exec, without
+ * wrapping the command in taskset / nice / ionice / chrt.
+ *   @cpu=0-3,6		CPU affinity
+ *   @nice=10		nice value, -20 to 19
+ *   @io=idle|be:N|rt:N	I/O scheduling class and level (0-7)
+ *   @sched=other|batch|idle|fifo:N|rr:N	scheduling policy and realtime priority (1-99)
+ * The struct is flat so it can be copied into a zygote request as is.
+ */
+
+#ifndef __SHELL_LAUNCH
+#define __SHELL_LAUNCH
+
+#define LAUNCH_CPU 1
+#define LAUNCH_NICE 2
+#define LAUNCH_IO 4
+#define LAUNCH_SCHED 8
+
+#define LAUNCH_MAX_CPUS 1024
+
+// Not in the libc headers, from linux/ioprio.h
+#define LAUNCH_IOPRIO_WHO_PROCESS 1
+#define LAUNCH_IOPRIO_CLASS_SHIFT 13
+#define LAUNCH_IOPRIO_CLASS_RT 1
+#define LAUNCH_IOPRIO_CLASS_BE 2
+#define LAUNCH_IOPRIO_CLASS_IDLE 3
+
+typedef struct launch_attr{
+	uint32_t set;
+	int32_t nice;
+	int32_t io_class, io_level;
+	int32_t policy, priority;
+	uint64_t cpus[LAUNCH_MAX_CPUS / 64];
+} launch_attr;
+
+// A named class of @io or @sched. Classes with lo == hi take no level.
+typedef struct launch_class{
+	const char *name;
+	int32_t id;
+	int32_t lo, hi, def;
+} launch_class;
+
+struct out_buffer;
+
+void launch_init(launch_attr *a);
+int launch_parse(launch_attr *a, char *token);
+int launch_apply(const launch_attr *a);
+void launch_print(struct out_buffer *out, const launch_attr *a);
+
+#endif
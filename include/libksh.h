@@ -0,0 +1,54 @@
+/**
+ * This is the API for embedding ksh. The parser, executor and job table are
+ * built as libksh, so a program can run command lines in-process instead of
+ * handing them to system() / popen(), which start a /bin/sh for every call.
+ *
+ * A ksh_shell is one shell: its own job table, builtin caches, plugins and
+ * last status. Any number can exist. The working directory and the standard
+ * fds are the process's, shared by all of them: redirection and pipes dup2
+ * over fds 0 / 1 / 2 while a line runs. So the library is not reentrant, the
+ * calls that run lines (ksh_create, ksh_destroy, ksh_run, ksh_spawn) take one
+ * process wide lock and lines from different threads run one at a time. A line
+ * must not call back into the library. Embedded shells never take the terminal.
+ * A fatal error (out of memory) in one, or in a child it forked, ends that
+ * process with _exit, so the host's atexit handlers never run in a child.
+ *
+ *     ksh_shell *sh = ksh_create();
+ *     int status = ksh_run(sh, "sort data | uniq > counts");
+ *
+ *     ksh_job *job = ksh_spawn(sh, "ls -l /tmp", KSH_CAPTURE_STDOUT);
+ *     if(ksh_wait(job) == 0){
+ *         size_t len;
+ *         const char *out = ksh_job_output(job, &len);
+ *     }
+ *     ksh_job_free(job);
+ *     ksh_destroy(sh);
+ */
+
+#ifndef __SHELL_LIBKSH
+#define __SHELL_LIBKSH
+
+#include<stddef.h>
+#include<sys/types.h>
+
+typedef struct Shell ksh_shell;
+typedef struct ksh_job ksh_job;
+
+// ksh_spawn flags
+#define KSH_CAPTURE_STDOUT 1
+#define KSH_CAPTURE_STDERR 2
+
+ksh_shell* ksh_create();
+void ksh_destroy(ksh_shell *sh);
+int ksh_run(ksh_shell *sh, const char *line);
+int ksh_last_status(ksh_shell *sh);
+
+ksh_job* ksh_spawn(ksh_shell *sh, const char *line, int flags);
+pid_t ksh_job_pid(ksh_job *job);
+int ksh_job_fd(ksh_job *job);
+int ksh_poll(ksh_job *job);
+int ksh_wait(ksh_job *job);
+const char* ksh_job_output(ksh_job *job, size_t *len);
+void ksh_job_free(ksh_job *job);
+
+#endif
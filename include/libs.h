@@ -24,24 +24,59 @@
 #include<fcntl.h>
 #include<time.h>
 #include<stdint.h>
+#include<stddef.h>
 #include<dirent.h>
 #include<grp.h>
 #include<termios.h>
 #include<ctype.h>
 #include<stdarg.h>
 #include<pthread.h>
+#include<sys/syscall.h>
+#include<sys/inotify.h>
+#include<sys/timerfd.h>
+#include<sys/eventfd.h>
+#include<poll.h>
+#include<sys/mman.h>
+#include<sys/resource.h>
+#include<sys/ioctl.h>
+#include<dlfcn.h>
+#include<signal.h>
+#include<spawn.h>
+#include<sys/socket.h>
+#include<sys/un.h>
+#include<linux/sched.h>
 
 // Self-defined include files
+#include "launch.h"
 #include "proclist.h"
 #include "error_handlers.h"
 #include "utils.h"
 #include "vector.h"
+#include "outbuf.h"
+#include "idcache.h"
+#include "parallel.h"
+#include "sort.h"
+#include "walk.h"
+#include "lscache.h"
+#include "procfs.h"
+#include "metrics.h"
+#include "record.h"
+#include "timers.h"
+#include "ksh_plugin.h"
+#include "plugins.h"
+#include "zygote.h"
 #include "shell.h"
+#include "libksh.h"
 #include "prompt.h"
 #include "parsing.h"
 #include "execute.h"
 #include "builtins.h"
 #include "ls.h"
+#include "du.h"
+#include "baywatch.h"
+#include "jobmon.h"
+#include "ptop.h"
+#include "server.h"
 #include "signal_handlers.h"
 #include "history.h"
 #include "colors.h"
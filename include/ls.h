@@ -1,6 +1,24 @@
 #ifndef __SHELL_BUILTIN_LS
 #define __SHELL_BUILTIN_LS
 
+typedef struct ls_entry{
+	string name;
+	struct stat sb;
+	int err;
+} ls_entry;
+
+typedef struct ls_dir{
+	string_pool names;
+	ls_entry *entries;
+	uint8_t *types;
+	uint32_t types_size;
+	uint32_t size;
+	int64_t total;
+	int err;
+	bool cached;
+} ls_dir;
+
 int ls(Command *c);
+void __destroy_dir(ls_dir *d);
 
-#endif
\ No newline at end of file
+#endif
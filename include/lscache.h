@@ -0,0 +1,41 @@
+/**
+ * This is the code for the (opt-in) ls listing cache. Sorted listings and their
+ * stat records are kept per directory, keyed by (dev, ino) and the flags that
+ * shaped them. Entries are invalidated by inotify watches on the directories, or
+ * by comparing the mtime / ctime of the directory if a watch can't be added.
+ */
+
+#ifndef __SHELL_LSCACHE
+#define __SHELL_LSCACHE
+
+#define DIRCACHE_SIZE 64
+#define DIRCACHE_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | \
+						 IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct dir_cache_entry{
+	dev_t dev;
+	ino_t ino;
+	int flags;
+	int wd;
+	struct timespec mtime, ctime;
+	struct ls_dir *list;
+	uint64_t age;
+} dir_cache_entry;
+
+typedef struct dir_cache{
+	bool enabled;
+	int ifd;
+	dir_cache_entry entries[DIRCACHE_SIZE];
+	uint32_t size;
+	uint64_t clock;
+	uint64_t hits, misses, invalidations;
+} dir_cache;
+
+void create_dircache(dir_cache *c);
+void destroy_dircache(dir_cache *c);
+void dircache_clear(dir_cache *c);
+void dircache_sync(dir_cache *c);
+struct ls_dir* dircache_get(dir_cache *c, string dirname, int flags, struct stat *sb);
+bool dircache_put(dir_cache *c, string dirname, int flags, struct stat *sb, struct ls_dir *list);
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * This is the code for the metrics engine behind baywatch. Metrics are
+ * registered in a table, each reading one /proc source. A sampler opens
+ * every source its columns need once, and on each tick reads each of them
+ * once and fills one row with a value per column. Parsing works in place
+ * on the read buffers, nothing is allocated per sample.
+ */
+
+#ifndef __SHELL_METRICS
+#define __SHELL_METRICS
+
+#define METRICS_MAX 32
+#define METRIC_NAME_MAX 32
+#define METRIC_DEVICES_MAX 32
+
+#define SRC_STAT 0
+#define SRC_MEMINFO 1
+#define SRC_INTERRUPTS 2
+#define SRC_LOADAVG 3
+#define SRC_DISKSTATS 4
+#define SRC_NETDEV 5
+#define SRC_COUNT 6
+
+#define METRIC_GAUGE 0
+#define METRIC_COUNTER 1
+
+struct metric;
+typedef int64_t (*metric_fn)(struct metric *m, char *buf);
+
+typedef struct metric_def{
+	const char *name;
+	const char *key;
+	int source;
+	int kind;
+	int decimals;
+	const char *help;
+	metric_fn read;
+} metric_def;
+
+/**
+ * One column of a sampler. Counters are reported as a rate per second,
+ * prev holds the raw values of the previous sample.
+ */
+typedef struct metric{
+	const metric_def *def;
+	char arg[METRIC_NAME_MAX];
+	char header[METRIC_NAME_MAX];
+	int64_t prev[2];
+	struct sampler *owner;
+} metric;
+
+typedef struct metric_row{
+	int64_t time_ns;
+	int64_t values[METRICS_MAX];
+} metric_row;
+
+typedef struct sampler{
+	proc_source src[SRC_COUNT];
+	metric cols[METRICS_MAX];
+	uint32_t ncols;
+	char devices[METRIC_DEVICES_MAX][METRIC_NAME_MAX];
+	uint32_t ndevices;
+	int64_t last_ns;
+	int64_t elapsed_ns;
+} sampler;
+
+extern const metric_def metric_defs[];
+
+void create_sampler(sampler *s);
+void destroy_sampler(sampler *s);
+int sampler_add(sampler *s, string spec);
+int sampler_open(sampler *s);
+void sampler_sample(sampler *s, metric_row *row);
+void sampler_print_header(sampler *s, out_buffer *out, bool csv);
+void sampler_print_row(sampler *s, metric_row *row, out_buffer *out, bool csv);
+void metrics_print_list(out_buffer *out);
+
+#endif
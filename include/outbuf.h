@@ -0,0 +1,32 @@
+/**
+ * This is the code for a simple output buffer used by the builtins. 
+ * stdout is unbuffered while the shell is running (see get_line) so every
+ * printf turns into a write syscall. Builtins instead print into an
+ * out_buffer which is flushed once at the end of the builtin, or earlier
+ * if the buffer fills up.
+ */
+
+#ifndef __SHELL_OUTBUF
+#define __SHELL_OUTBUF
+
+#define OUTBUF_SIZE (1<<20)
+#define OUTBUF_CAPTURE -1
+
+typedef struct out_buffer{
+	char *buf;
+	size_t used;
+	size_t cap;
+	int fd;
+} out_buffer;
+
+void create_buffer(out_buffer *b, int fd, size_t cap);
+void destroy_buffer(out_buffer *b);
+int buf_write(out_buffer *b, const char *data, size_t len);
+int buf_printf(out_buffer *b, const char *format, ...);
+int buf_vprintf(out_buffer *b, const char *format, va_list args);
+int buf_flush(out_buffer *b);
+int bprintf(const char *format, ...);
+int bputs(const char *str);
+int bflush();
+
+#endif
@@ -0,0 +1,22 @@
+/**
+ * This is the code for a minimal fork-join worker pool. parallel_for splits
+ * [0, n) into chunks of `grain` items which are handed out to worker threads
+ * until none are left. The calling thread works as well and returns once
+ * every chunk has been processed. Calls made from inside a parallel_for (or
+ * another pool's worker) run inline, so nesting doesn't multiply the threads.
+ */
+
+#ifndef __SHELL_PARALLEL
+#define __SHELL_PARALLEL
+
+#define MAX_WORKERS 64
+
+typedef void (*range_fn)(void *arg, uint32_t begin, uint32_t end);
+
+// Set on threads that already run in parallel with their siblings
+extern _Thread_local bool in_parallel;
+
+uint32_t num_workers();
+void parallel_for(uint32_t n, uint32_t grain, range_fn fn, void *arg);
+
+#endif
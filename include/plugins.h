@@ -0,0 +1,44 @@
+/**
+ * This is the code for loading builtin plugins (see ksh_plugin.h for the ABI).
+ * Plugin builtins are kept in a table next to the generated one of the core
+ * builtins: their ids follow the core ids, so a command resolved to one at
+ * parse time dispatches the same way. Libraries are unloaded once none of
+ * their builtins are enabled.
+ */
+
+#ifndef __SHELL_PLUGINS
+#define __SHELL_PLUGINS
+
+typedef struct plugin_lib{
+	void *handle;
+	string path;
+	const ksh_plugin_info *info;
+	uint32_t enabled;
+} plugin_lib;
+
+typedef struct plugin_builtin{
+	string name;
+	const ksh_builtin_def *def;
+	plugin_lib *lib;
+} plugin_builtin;
+
+/**
+ * running is set for the duration of a plugin call, so the SIGINT handler sets
+ * cancelled instead of redrawing the prompt.
+ */
+typedef struct plugin_table{
+	plugin_builtin *builtins;
+	uint32_t size, cap;
+	plugin_lib **libs;
+	uint32_t nlibs, libcap;
+	volatile sig_atomic_t running, cancelled;
+} plugin_table;
+
+struct Command;
+
+void create_plugins(plugin_table *t);
+void destroy_plugins(plugin_table *t);
+int plugin_find(plugin_table *t, const char *name);
+int plugin_call(plugin_table *t, int index, struct Command *c);
+
+#endif
@@ -0,0 +1,137 @@
+/**
+ * This is the code for reading /proc. Files are parsed into typed structs
+ * straight from stack buffers (or from the buffer of a proc_source that
+ * is kept open and re-read). Callers pass a mask of the fields they need:
+ * only those are filled, and parsing stops as soon as all of them are found.
+ */
+
+#ifndef __SHELL_PROCFS
+#define __SHELL_PROCFS
+
+#define PROCFS_BUF_SIZE 4096
+#define PROCFS_STAT_SIZE 1024
+#define PROC_COMM_MAX 64
+
+/**
+ * A /proc file kept open for as long as it is sampled. Every read preads
+ * it from offset 0 into buf, which only grows when the file does.
+ */
+typedef struct proc_source{
+	int fd;
+	char *buf;
+	size_t cap;
+} proc_source;
+
+// /proc/pid/stat. Fields are parsed after the last ')' so comm can hold anything.
+#define PS_COMM (1<<0)
+#define PS_STATE (1<<1)
+#define PS_PPID (1<<2)
+#define PS_PGRP (1<<3)
+#define PS_SESSION (1<<4)
+#define PS_TTY (1<<5)
+#define PS_TPGID (1<<6)
+#define PS_TIMES (1<<7)
+#define PS_PRIO (1<<8)
+#define PS_THREADS (1<<9)
+#define PS_START (1<<10)
+#define PS_VSIZE (1<<11)
+#define PS_RSS (1<<12)
+
+typedef struct proc_stat{
+	pid_t pid;
+	char comm[PROC_COMM_MAX];
+	char state;
+	pid_t ppid, pgrp, session;
+	int tty_nr;
+	pid_t tpgid;
+	uint64_t utime, stime;
+	int64_t priority, nice;
+	int64_t num_threads;
+	uint64_t starttime;
+	uint64_t vsize;
+	int64_t rss;
+} proc_stat;
+
+// /proc/pid/status. Memory is in kB.
+#define PST_NAME (1<<0)
+#define PST_STATE (1<<1)
+#define PST_TGID (1<<2)
+#define PST_PPID (1<<3)
+#define PST_UID (1<<4)
+#define PST_VMSIZE (1<<5)
+#define PST_VMRSS (1<<6)
+#define PST_THREADS (1<<7)
+#define PST_CTXT (1<<8)
+
+typedef struct proc_status{
+	char name[PROC_COMM_MAX];
+	char state;
+	int64_t tgid, ppid;
+	int64_t uid, euid;
+	int64_t vm_size, vm_rss;
+	int64_t threads;
+	int64_t voluntary_ctxt, nonvoluntary_ctxt;
+} proc_status;
+
+// /proc/pid/io
+#define PIO_RCHAR (1<<0)
+#define PIO_WCHAR (1<<1)
+#define PIO_SYSCR (1<<2)
+#define PIO_SYSCW (1<<3)
+#define PIO_READ_BYTES (1<<4)
+#define PIO_WRITE_BYTES (1<<5)
+#define PIO_CANCELLED (1<<6)
+
+typedef struct proc_io{
+	int64_t rchar, wchar;
+	int64_t syscr, syscw;
+	int64_t read_bytes, write_bytes;
+	int64_t cancelled_write_bytes;
+} proc_io;
+
+// /proc/meminfo, in kB
+#define PM_TOTAL (1<<0)
+#define PM_FREE (1<<1)
+#define PM_AVAILABLE (1<<2)
+#define PM_BUFFERS (1<<3)
+#define PM_CACHED (1<<4)
+#define PM_DIRTY (1<<5)
+#define PM_WRITEBACK (1<<6)
+#define PM_SWAP_TOTAL (1<<7)
+#define PM_SWAP_FREE (1<<8)
+
+typedef struct proc_meminfo{
+	int64_t total, free, available;
+	int64_t buffers, cached;
+	int64_t dirty, writeback;
+	int64_t swap_total, swap_free;
+} proc_meminfo;
+
+// /proc/loadavg. Load averages are in hundredths.
+typedef struct proc_loadavg{
+	int64_t load[3];
+	int64_t running, total;
+	pid_t last_pid;
+} proc_loadavg;
+
+int proc_open(proc_source *s, const char *path);
+ssize_t proc_read(proc_source *s);
+void proc_close(proc_source *s);
+char* proc_find_line(char *buf, const char *key);
+int procfs_open(pid_t pid, const char *file);
+
+int procfs_parse_stat(char *buf, proc_stat *st, uint32_t mask);
+int procfs_parse_status(char *buf, proc_status *st, uint32_t mask);
+int procfs_parse_io(char *buf, proc_io *io, uint32_t mask);
+int procfs_parse_meminfo(char *buf, proc_meminfo *m, uint32_t mask);
+int procfs_parse_loadavg(char *buf, proc_loadavg *l);
+int procfs_parse_irq(char *buf, const char *irq, int64_t *count);
+
+int procfs_read_stat(int fd, proc_stat *st, uint32_t mask);
+int procfs_read_status(int fd, proc_status *st, uint32_t mask);
+int procfs_read_io(int fd, proc_io *io, uint32_t mask);
+int procfs_read_meminfo(int fd, proc_meminfo *m, uint32_t mask);
+int procfs_read_loadavg(int fd, proc_loadavg *l);
+int procfs_read_irq(int fd, const char *irq, int64_t *count);
+
+#endif
@@ -5,6 +5,10 @@ typedef struct Process{
 	pid_t id;
 	uint64_t job_num;
 	char *str;
+	int stat_fd, io_fd;
+	uint64_t cpu_ticks;
+	int64_t sampled_ns;
+	launch_attr launch;
 	struct Process *next;
 	struct Process *prev; 
 } Process;
@@ -0,0 +1,46 @@
+#ifndef __SHELL_BUILTIN_PTOP
+#define __SHELL_BUILTIN_PTOP
+
+#define PTOP_MIN_SLOTS 1024
+#define PTOP_DENTS_BUF (1 << 16)
+// fds left free for the rest of the shell when caching stat fds
+#define PTOP_FD_RESERVE 64
+#define PTOP_MAX_CACHED_FDS (1 << 16)
+
+#define PTOP_SORT_CPU 0
+#define PTOP_SORT_MEM 1
+
+/**
+ * State kept for a pid across refreshes. fd is its /proc/pid/stat, kept
+ * open while the fd budget allows. seen is the generation of the last scan
+ * that found the pid; entries that miss a scan are evicted. cpu is in tenths
+ * of a percent of one CPU.
+ */
+typedef struct ptop_entry{
+	pid_t pid;
+	int fd;
+	uint32_t seen;
+	uint64_t ticks;
+	uint64_t starttime;
+	int64_t cpu;
+	proc_stat st;
+} ptop_entry;
+
+/**
+ * Open addressed (linear probing) map from pid to its entry. A pid of 0 marks
+ * an empty slot. Removal shifts the following entries back, so there are
+ * no tombstones and lookups never degrade.
+ */
+typedef struct ptop_table{
+	ptop_entry *slots;
+	uint32_t cap, size;
+	uint32_t gen;
+	int procfd;
+	int loadfd;
+	uint32_t nfds, max_fds;
+	int64_t last_ns;
+} ptop_table;
+
+int ptop(Command *c);
+
+#endif
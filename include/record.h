@@ -0,0 +1,44 @@
+/**
+ * This is the code for baywatch recordings. A recording is a fixed size
+ * file mapped into memory, holding a header and a ring of fixed width
+ * rows (time followed by one int64 per column, native byte order). The
+ * recorder copies a row into its slot and then bumps the row count, so
+ * appending costs no syscall and readers can tell which rows were
+ * overwritten while they were being read.
+ */
+
+#ifndef __SHELL_RECORD
+#define __SHELL_RECORD
+
+#define RECORD_MAGIC "KSHBWREC"
+#define RECORD_VERSION 1
+#define RECORD_HEADER_SIZE 4096
+#define RECORD_DEFAULT_ROWS 86400
+
+typedef struct record_header{
+	char magic[8];
+	uint32_t version;
+	uint32_t ncols;
+	uint64_t capacity;
+	int64_t interval_ns;
+	uint64_t head;
+	char cols[METRICS_MAX][METRIC_NAME_MAX];
+} record_header;
+
+typedef struct bw_record{
+	int fd;
+	void *map;
+	size_t size;
+	record_header *hdr;
+	int64_t *rows;
+	uint32_t row_words;
+	uint64_t capacity;
+} bw_record;
+
+int record_create(bw_record *r, string path, sampler *s, struct timespec *interval, uint64_t capacity);
+int record_open(bw_record *r, string path);
+void record_append(bw_record *r, metric_row *row);
+void record_close(bw_record *r);
+int record_print(bw_record *r, out_buffer *out, bool csv);
+
+#endif
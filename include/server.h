@@ -0,0 +1,47 @@
+/**
+ * This is the code for the command server. `ksh --serve path` sets the shell
+ * up once and listens on a Unix socket. Each connection is handled by a fork
+ * of the warm server, which runs the command lines the client sends with the
+ * regular parser and executor and streams their stdout, stderr and exit
+ * status back. State such as the working directory carries over between the
+ * lines of one connection. `ksh --client path [cmd...]` is the client.
+ */
+
+#ifndef __SHELL_SERVER
+#define __SHELL_SERVER
+
+// Every message is a header followed by len bytes of payload, in host byte order
+#define SRV_CMD 1		// client -> server: a command line
+#define SRV_OUT 2		// server -> client: a chunk of stdout
+#define SRV_ERR 3		// server -> client: a chunk of stderr
+#define SRV_STATUS 4	// server -> client: int32_t status, ends the reply to a command
+
+#define SRV_CHUNK 16384
+#define SRV_BACKLOG 64
+
+// struct ucred, which libc only declares with _GNU_SOURCE
+typedef struct srv_peer{
+	pid_t pid;
+	uid_t uid;
+	gid_t gid;
+} srv_peer;
+
+typedef struct srv_header{
+	uint32_t type;
+	uint32_t len;
+} srv_header;
+
+/**
+ * The output of the command being run. The connection's forwarder thread
+ * reads the pipes the command writes to and sends it on as it comes.
+ */
+typedef struct srv_stream{
+	int conn;
+	int out, err;
+	bool dead;
+} srv_stream;
+
+int ksh_serve(string path);
+int ksh_client(string path, int argc, char *argv[]);
+
+#endif
@@ -1,8 +1,9 @@
 /**
  * This file contains a few structs that define the functioning
- * of the shell. Shell is an extern state variable shared across
- * all files. Command will contain all information required to process
- * any single command.
+ * of the shell. Shell holds the whole state of a shell, KSH is the one
+ * the current thread works on (the interactive shell's unless an embedder
+ * switched it, see libksh.h). Command will contain all information
+ * required to process any single command.
  */
 
 #ifndef __SHELL_INCLUDE
@@ -27,16 +28,28 @@ typedef struct Shell{
 	History history;
 	int stdin, saved_stdin;
 	int stdout, saved_stdout;
+	int detach_fd;
 	uint64_t jobs_spawned;
+	out_buffer out;
+	id_cache users, groups;
+	dir_cache dcache;
+	struct bw_watch *recorder;
+	timer_wheel timers;
+	plugin_table plugins;
+	zygote_proc zygote;
+	bool background;
+	int status;
 } Shell;
 
 typedef struct Command{
 	string name;
+	int builtin;
 	int argc;
 	string_vector argv;
 	string infile;
 	string outfile;
 	bool runInBackground;
+	launch_attr launch;
 	bool append;
 	bool valid;
 } Command;
@@ -46,8 +59,9 @@ typedef struct Pipe{
 	struct Pipe *next;
 } Pipe;
 
-// Declares it and makes it accessible in all files this header is included in
-extern Shell KSH;
+// The shell state the current thread works on. Worker threads inherit their spawner's.
+extern _Thread_local Shell *ksh_ctx;
+#define KSH (*ksh_ctx)
 extern string getline_inp;
 extern int getline_pt;
 
@@ -0,0 +1,22 @@
+/**
+ * This is the code for sorting listings of names. Every name is case folded
+ * once into a key arena, so comparisons are plain byte compares. Large inputs
+ * are sorted with an MSD radix sort over the folded keys whose top level
+ * buckets are spread over the worker pool. Small inputs (and sorts on a
+ * numeric key) use an introsort. Sorting produces a permutation, the caller
+ * reorders its own arrays with it.
+ */
+
+#ifndef __SHELL_SORT
+#define __SHELL_SORT
+
+// Inputs with at least this many names are radix sorted
+#define RADIX_SORT_MIN 4096
+// Buckets / partitions smaller than this are insertion sorted
+#define INSERTION_SORT_MAX 16
+
+uint32_t* sort_names(string *names, uint32_t n, bool casesens);
+uint32_t* sort_by_key(string *names, const int64_t *keys, uint32_t n);
+void apply_permutation(void *arr, size_t elem_size, const uint32_t *perm, uint32_t n);
+
+#endif
@@ -0,0 +1,58 @@
+/**
+ * This is the code for timers: shell commands run periodically (every) or
+ * once (at). Tasks live in a hierarchical timer wheel of TIMER_LEVELS levels
+ * of TIMER_SLOTS slots, each level covering TIMER_SLOTS times the span of the
+ * one below it. Insert and cancel are O(1) list operations; a task is moved
+ * down a level when the level below it wraps around. A timerfd is armed for
+ * the next slot that has work, the prompt polls it while it waits for input.
+ */
+
+#ifndef __SHELL_TIMERS
+#define __SHELL_TIMERS
+
+#define TIMER_TICK_NS 10000000LL
+#define TIMER_BITS 6
+#define TIMER_SLOTS (1 << TIMER_BITS)
+#define TIMER_LEVELS 4
+// Tasks further out than the wheel spans (~46h) are parked in the last level and re-placed
+#define TIMER_SPAN (1LL << (TIMER_BITS * TIMER_LEVELS))
+
+/**
+ * A scheduled command. expires and period are in ticks, period is 0 for one
+ * shot tasks. pid is the subshell of the last run, a run is skipped while
+ * it is still alive.
+ */
+typedef struct timer_task{
+	uint32_t id;
+	int64_t expires;
+	int64_t period;
+	string cmd;
+	pid_t pid;
+	uint64_t runs, skipped;
+	int level, slot;
+	struct timer_task *prev, *next;
+} timer_task;
+
+/**
+ * now is the next tick to be processed. occupied has a bit set per non empty
+ * slot, so the next tick with work is found without walking slots. Tasks are
+ * also indexed by id (id - 1) for cancelling, freed ids are reused.
+ */
+typedef struct timer_wheel{
+	timer_task *slots[TIMER_LEVELS][TIMER_SLOTS];
+	uint64_t occupied[TIMER_LEVELS];
+	int64_t now;
+	int64_t base_ns;
+	int tfd;
+	timer_task **tasks;
+	uint32_t ntasks, cap;
+	uint32_t count;
+} timer_wheel;
+
+void create_wheel(timer_wheel *w);
+void destroy_wheel(timer_wheel *w);
+timer_task* timer_add(timer_wheel *w, int64_t delay_ns, int64_t period_ns, string cmd);
+int timer_cancel(timer_wheel *w, uint32_t id);
+void timers_run(timer_wheel *w);
+
+#endif
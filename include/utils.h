@@ -9,12 +9,20 @@
 
 typedef char* string;
 
+// Record layout of the getdents64 syscall, glibc doesn't export it
+struct linux_dirent64{
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
 #define ISPARENT(X) X
 #define ISCHILD(X) !X
 
-#define STAT_STATUS 3
-#define STAT_PGRPID 5
-#define STAT_VMSIZE 23
+
+#define MIN_INTERVAL_NS 1000000
 
 #define HISTORY_SIZE 20
 #define DEFAULT_HIS_OUTPUT 10
@@ -22,15 +30,18 @@ typedef char* string;
 #define HISTORY_NAME "~/.ksh_history"
 
 void init();
+void init_state();
 string get_cwd();
 string get_prompt_dir();
 void replace_tilda(string *path_adr);
 void reverse_replace_tilda(string *path_adr);
 void swapstring(string *a, string *b);
 int64_t string_to_int(string str);
+int string_to_interval(string str, struct timespec *ts);
 int min(int a, int b);
 int max(int a, int b);
 void cleanup();
+void cleanup_state();
 bool isPOSIXFilechar(char c);
 void make_fg_process(pid_t pid);
 void make_fg_parent();
@@ -23,6 +23,39 @@ void create_vector(string_vector*, uint32_t n);
 void destroy_vector(string_vector*);
 void vec_sort(string_vector*, bool);
 
+/**
+ * Pooled variant for bulk string lists (ls listings). All strings live
+ * NUL terminated in one growable byte arena and are addressed by an
+ * offset / length index, so a list costs two allocations instead of one
+ * per string. Sorting only permutes the index. Pointers returned by
+ * pool_at are invalidated by the next pool_push.
+ */
+typedef struct pool_slot{
+	uint32_t off;
+	uint32_t len;
+} pool_slot;
+
+typedef struct string_pool{
+	char *bytes;
+	size_t used;
+	size_t cap;
+	pool_slot *index;
+	uint32_t size;
+	uint32_t table_size;
+} string_pool;
+
+void create_pool(string_pool*, uint32_t n, size_t bytes);
+void destroy_pool(string_pool*);
+void pool_reserve(string_pool*, uint32_t n, size_t bytes);
+void pool_push(string_pool*, const char*, uint32_t len);
+void pool_clear(string_pool*);
+string* pool_view(string_pool*);
+void pool_sort(string_pool*, bool);
+
+#define pool_at(p, i) ((p)->bytes + (p)->index[(i)].off)
+#define pool_len(p, i) ((p)->index[(i)].len)
+
+#define VECTOR_MIN_SIZE 16
 #define CASE_SENSITIVE_SORT 1
 #define CASE_INSENSITIVE_SORT 0
 
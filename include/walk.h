@@ -0,0 +1,60 @@
+/**
+ * This is the code for a parallel directory tree walker. Directories are 
+ * visited by worker threads which share work through work-stealing deques:
+ * a worker pops the directories it discovered itself LIFO and steals the
+ * oldest ones from other workers when it runs dry. Each visit buffers its
+ * results in its node, and the calling thread consumes the nodes in depth
+ * first order as they complete, so output is deterministic. Workers park
+ * when there is nothing to take or once WALK_LOOKAHEAD visited nodes wait
+ * for the calling thread, which visits the nodes it needs next itself when
+ * no worker got to them (or no worker could be started).
+ */
+
+#ifndef __SHELL_WALK
+#define __SHELL_WALK
+
+#define WALK_LOOKAHEAD 256
+
+typedef struct walk_node{
+	string path;
+	uint32_t depth;
+	struct walk_node *parent;
+	struct walk_node **children;
+	uint32_t nchildren;
+	uint32_t children_size;
+	out_buffer out;
+	int64_t blocks;
+	dev_t dev;
+	// A visitor may keep the directory open for its children to openat, -1 otherwise
+	int fd;
+	uint32_t unvisited;
+	// Anything else the visitor keeps for w->pre / w->post, which free it
+	void *data;
+	int err;
+	bool done;
+	struct walk_deque *queue;
+} walk_node;
+
+typedef struct walk_deque{
+	walk_node **arr;
+	uint32_t head, tail;
+	uint32_t table_size;
+	pthread_mutex_t lock;
+} walk_deque;
+
+typedef struct walker{
+	void (*visit)(struct walker *w, walk_node *node);
+	void (*pre)(struct walker *w, walk_node *node);
+	void (*post)(struct walker *w, walk_node *node);
+	void *arg;
+	uint32_t nthreads;
+	walk_deque *deques;
+	int64_t pending, queued, buffered;
+	pthread_mutex_t lock;
+	pthread_cond_t cond, work;
+} walker;
+
+walk_node* walk_add_child(walk_node *parent, string name);
+void walk_tree(walker *w, string *roots, uint32_t n);
+
+#endif
@@ -0,0 +1,52 @@
+/**
+ * This is the code for the zygote: a small helper process that launches
+ * system commands on behalf of the shell. It is a fresh exec of ksh that
+ * never sets up the shell state, so its address space stays a fraction of
+ * the shell's and it has no threads. Launching a command is then a clone of
+ * the zygote instead of a fork of the shell. The shell sends it requests
+ * (process group, umask, launch attributes and argv, with the command's stdin / stdout /
+ * stderr and the shell's working directory attached through SCM_RIGHTS) over a
+ * socketpair. The command is cloned with CLONE_PARENT, so it is the shell's child
+ * and job control works as usual. Resource limits and the environment are the
+ * shell's as of `zygote on`.
+ */
+
+#ifndef __SHELL_ZYGOTE
+#define __SHELL_ZYGOTE
+
+// Largest request: the header and argv, NUL separated. Longer argvs fork the shell.
+#define ZYGOTE_MSG_MAX (1<<16)
+// stdin, stdout, stderr, then the working directory
+#define ZYGOTE_STDIO 3
+#define ZYGOTE_CWD 3
+#define ZYGOTE_FDS 4
+
+typedef struct zygote_proc{
+	pid_t pid;
+	int fd;
+	// The shell that started it. Its clones are that shell's children, so forks of it fork.
+	pid_t owner;
+	uint64_t launched;
+	char *msg;
+} zygote_proc;
+
+typedef struct zygote_request{
+	int32_t pgid;
+	uint32_t umask;
+	launch_attr launch;
+} zygote_request;
+
+typedef struct zygote_reply{
+	int32_t pid;
+	int32_t err;
+} zygote_reply;
+
+extern string zygote_exe;
+
+void create_zygote(zygote_proc *z);
+int zygote_start(zygote_proc *z);
+void zygote_stop(zygote_proc *z);
+pid_t zygote_spawn(zygote_proc *z, char **argv, int argc, pid_t pgid, const launch_attr *launch);
+int zygote_main(int fd);
+
+#endif
@@ -0,0 +1,242 @@
+#include "libs.h"
+#include "baywatch.h"
+
+/**
+ * @brief Sampling thread. Samples on a periodic timerfd until stopfd is signalled.
+ * @details The timer is armed on absolute CLOCK_MONOTONIC ticks, so the interval
+ * does not drift by the time spent sampling. If sampling overruns a tick, the 
+ * missed ticks are dropped rather than sampled back to back.
+ */
+void *__bw_loop(void *arg){
+	bw_watch *w = arg;
+	int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if(tfd == -1){
+		perror("baywatch");
+		return NULL;
+	}
+	// The sampler took its baseline when it was opened, first row is one interval later
+	struct itimerspec its = {.it_interval = w->interval};
+	clock_gettime(CLOCK_MONOTONIC, &its.it_value);
+	its.it_value.tv_sec += w->interval.tv_sec;
+	its.it_value.tv_nsec += w->interval.tv_nsec;
+	if(its.it_value.tv_nsec >= 1000000000){
+		its.it_value.tv_sec++;
+		its.it_value.tv_nsec -= 1000000000;
+	}
+	timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+
+	metric_row row;
+	struct pollfd fds[2] = {{tfd, POLLIN, 0}, {w->stopfd, POLLIN, 0}};
+	while(poll(fds, 2, -1) != -1 || errno == EINTR){
+		if(fds[1].revents) break;
+		if(!(fds[0].revents & POLLIN)) continue;
+
+		uint64_t ticks;
+		if(read(tfd, &ticks, sizeof(ticks)) != sizeof(ticks)) continue;
+		sampler_sample(&w->s, &row);
+		if(w->recording) record_append(&w->rec, &row);
+		if(w->print){
+			sampler_print_row(&w->s, &row, &w->out, w->csv);
+			buf_flush(&w->out);
+		}
+	}
+	close(tfd);
+	return NULL;
+}
+
+/**
+ * @brief Opens the sources and the recording of a watch and starts its sampling thread
+ * @return 0 on success, -1 on failure
+ */
+int __bw_start(bw_watch *w, uint64_t rows){
+	// Sources stay open for the whole watch
+	if(check_perror("baywatch", sampler_open(&w->s), -1)){
+		destroy_sampler(&w->s);
+		return -1;
+	}
+	if(w->path && check_perror("baywatch", record_create(&w->rec, w->path, &w->s, &w->interval, rows), -1)){
+		destroy_sampler(&w->s);
+		return -1;
+	}
+	w->recording = (w->path != NULL);
+	w->stopfd = eventfd(0, EFD_CLOEXEC);
+	if(check_perror("baywatch", w->stopfd, -1)){
+		if(w->recording) record_close(&w->rec);
+		destroy_sampler(&w->s);
+		return -1;
+	}
+	if(w->print) sampler_print_header(&w->s, &KSH.out, w->csv);
+	bflush();
+	create_buffer(&w->out, STDOUT_FILENO, 4096);
+	w->owner = getpid();
+
+	// Create a new thread where the watcher will output contents 
+	pthread_create(&w->thread, NULL, __bw_loop, w);
+	return 0;
+}
+
+/**
+ * @brief Stops the sampling thread between two ticks and releases the watch
+ */
+void __bw_stop(bw_watch *w){
+	uint64_t one = 1;
+	write(w->stopfd, &one, sizeof(one));
+	pthread_join(w->thread, NULL);
+
+	close(w->stopfd);
+	if(w->recording) record_close(&w->rec);
+	destroy_sampler(&w->s);
+	destroy_buffer(&w->out);
+	free(w->path);
+}
+
+/**
+ * @brief Stops the background recorder, if this process started one
+ * @details Forked children inherit KSH.recorder but not the thread, they leave it alone.
+ */
+void baywatch_stop(){
+	bw_watch *w = KSH.recorder;
+	if(!w || w->owner != getpid()) return;
+	__bw_stop(w);
+	free(w);
+	KSH.recorder = NULL;
+}
+
+/**
+ * @brief Only the non interactive forms of baywatch can have their i/o redirected
+ */
+bool baywatch_redirectable(Command *c){
+	for(int i=1; i<=c->argc; i++)
+		if(!strcmp(c->argv.arr[i], "--replay") || !strcmp(c->argv.arr[i], "--list")) return true;
+	return false;
+}
+
+/**
+ * @brief Prints a recording as a table or as CSV
+ * @return 0 on success, -1 on failure
+ */
+int __bw_replay(string path, bool csv){
+	bw_record rec;
+	if(check_perror("baywatch", record_open(&rec, path), -1)) return -1;
+	int ret = record_print(&rec, &KSH.out, csv);
+	record_close(&rec);
+	if(ret == -1){
+		bprintf("baywatch: %s was recorded with metrics this shell does not know\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Similar to the watch command. Samples any set of metrics (see `baywatch --list`)
+ * at intervals of `n` seconds until the key `q` is pressed, and prints a row per sample
+ * @details Usage: 
+ * `baywatch [-n secs] [--csv] [--record file [--rows N]] metric... [&]`
+ * `baywatch --replay file [--csv | --export csv]`
+ * `baywatch --stop`
+ * Intervals can be fractional down to a millisecond, ex: `-n 0.05`, and default to a
+ * second. Rows are printed as an aligned table, or as CSV with --csv. --record also
+ * keeps the last N rows (a day at 1s by default) in a ring buffer file. With `&` the 
+ * recorder runs in the background without printing until `baywatch --stop`.
+ */
+int baywatch(Command *c){
+	bw_watch w = {0};
+	w.interval.tv_sec = 1;
+	w.print = true;
+	create_sampler(&w.s);
+	string replay = NULL;
+	uint64_t rows = RECORD_DEFAULT_ROWS;
+	int ret = 0;
+
+	for(int i=1; i<=c->argc; i++){
+		string arg = c->argv.arr[i];
+		bool has_value = (i < c->argc);
+		// --list and --stop ignore the other options, --record may have come before them
+		if(!strcmp(arg, "--list")){
+			free(w.path);
+			metrics_print_list(&KSH.out);
+			return 0;
+		}
+		else if(!strcmp(arg, "--stop")){
+			free(w.path);
+			if(!KSH.recorder){
+				bputs("baywatch: no recording in progress");
+				return -1;
+			}
+			bw_watch *r = KSH.recorder;
+			bprintf("baywatch: stopped recording to %s after %lu samples\n", r->path, r->rec.hdr->head);
+			baywatch_stop();
+			return 0;
+		}
+		else if(!strcmp(arg, "--csv"))
+			w.csv = true;
+		else if(!strcmp(arg, "--export") && has_value && !strcmp(c->argv.arr[i+1], "csv")){
+			w.csv = true;
+			i++;
+		}
+		else if(!strcmp(arg, "--replay") && has_value)
+			replay = c->argv.arr[++i];
+		else if(!strcmp(arg, "--record") && has_value && !w.path)
+			w.path = check_bad_alloc(strdup(c->argv.arr[++i]));
+		else if(!strcmp(arg, "--rows") && has_value){
+			int64_t n = string_to_int(c->argv.arr[++i]);
+			if(n <= 0) ret = -1;
+			else rows = n;
+		}
+		else if(!strcmp(arg, "-n")){
+			// Get interval time
+			if(!has_value || string_to_interval(c->argv.arr[++i], &w.interval) == -1) ret = -1;
+		}
+		else if(arg[0] == '-') 
+			ret = -1;
+		else if(sampler_add(&w.s, arg) == -1){
+			bprintf("baywatch: unknown metric '%s'. See baywatch --list for the available metrics.\n", arg);
+			free(w.path);
+			return -1;
+		}
+	}
+
+	if(replay && !w.s.ncols && !w.path && ret != -1)
+		return __bw_replay(replay, w.csv);
+
+	// Background watches only make sense when recording
+	if(ret == -1 || replay || !w.s.ncols || (c->runInBackground && !w.path)){
+		free(w.path);
+		throw_error(BAD_ARGS); return -1;
+	}
+	if(c->runInBackground && KSH.recorder){
+		bprintf("baywatch: already recording to %s, stop it with baywatch --stop\n", KSH.recorder->path);
+		free(w.path);
+		return -1;
+	}
+
+	if(c->runInBackground){
+		bw_watch *bg = check_bad_alloc(malloc(sizeof(bw_watch)));
+		*bg = w;
+		bg->print = false;
+		if(__bw_start(bg, rows) == -1){
+			free(bg->path);
+			free(bg);
+			return -1;
+		}
+		KSH.recorder = bg;
+		return 0;
+	}
+
+	if(__bw_start(&w, rows) == -1){
+		free(w.path);
+		return -1;
+	}
+
+	// Enable raw mode so we can setup a listener for the `q` key
+	enableRawMode();
+	char ch;
+	// Check for `q` press
+	while(read(STDIN_FILENO, &ch, 1)==1)
+		if(ch=='q') break;
+
+	// Set terminal back to normal
+	__bw_stop(&w);
+	disableRawMode();
+	return 0;
+}
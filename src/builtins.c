@@ -1,186 +1,90 @@
 #include "libs.h"
 #include "builtins.h"
 
-char *builtins[] = {"cd", "pwd", "echo", "ls", "repeat", "pinfo", "history", 
-					"jobs", "sig", "bg", "fg", "replay", "baywatch", NULL};
-int (*jumptable[])(Command *c) = {cd, pwd, echo, ls, repeat, pinfo, history, jobs, sig, bg, fg, replay, baywatch};
+#include "builtin_hash.h"
+#include "builtins_table.h"
 
+#define BUILTIN(name) #name,
+char *builtins[] = {
+#include "builtins.def"
+	NULL
+};
+#undef BUILTIN
+
+#define BUILTIN(name) name,
+int (*jumptable[])(Command *c) = {
+#include "builtins.def"
+};
+#undef BUILTIN
+
+
+/**
+ * @brief Resolves a command name to its builtin id, its index in jumptable
+ * @details The generated table is a perfect hash over the builtin names: the
+ * builtin in the slot the name hashes to is the only candidate, one strcmp decides.
+ * Names that aren't core builtins are looked up among the enabled plugin builtins.
+ * 
+ * @return The builtin id, -1 if name isn't a builtin
+ */
+int builtin_id(const char *name){
+	int id = builtin_slots[builtin_hash(name, BUILTIN_HASH_SEED) & (BUILTIN_TABLE_SIZE - 1)];
+	if(id != -1 && !strcmp(name, builtins[id])) return id;
+
+	// Plugin builtins are numbered after the core ones
+	int index = plugin_find(&KSH.plugins, name);
+	return (index == -1) ? -1 : BUILTIN_COUNT + index;
+}
 
 /**
  * @brief Check if the command is a builtin command
  */
 bool is_builtin(char *name){
-	char **builtin = builtins;
-	for(;(*builtin)!=NULL; builtin++)
-		if(!strcmp(name, *builtin)) return true;
-	return false;
+	return builtin_id(name) != -1;
 }
 
 /**
  * @brief Execute a builtin command
+ * @details Builtins print into the shell's output buffer. It is flushed once the
+ * builtin returns, while any redirection / pipe for this command is still in place.
  *
- * @param c MUST be a builtin command, or will sigsev. Check with is_builtin first.
+ * @param c MUST be a builtin command, or will sigsev. Its id was resolved by init_command.
  * @return Returns 0 on successful execution. -1 on failure.
  */
 int exec_builtin(Command *c){
-	char **builtin = builtins;
-	int ret = -1;
-	for(int id=0;(*builtin)!=NULL; builtin++, id++)
-		if(!strcmp(c->name, *builtin)) ret = (*jumptable[id])(c);
+	int ret = (c->builtin < BUILTIN_COUNT) ? (*jumptable[c->builtin])(c) : 
+			  plugin_call(&KSH.plugins, c->builtin - BUILTIN_COUNT, c);
+	check_perror("KSH", bflush(), -1);
 	return ret;
 }
 
 /**
- * @brief Prints the size of the memory which is dirty.
- * @details Reads information from the `Dirty:` column in /proc/meminfo. 
- * Infinite loop sleeping in intervals of t.
- */
-void *bw_dirty(void *interval){
-	int t = *((int*)interval);
-	char *buf = NULL;
-	size_t buf_size = 0;
-	while(1){
-		FILE *fptr = fopen("/proc/meminfo", "r");
-
-		while(getline(&buf, &buf_size, fptr)){
-			if(!strncmp(buf, "Dirty:", 6)){
-				printf("%s", &buf[6]);
-				break;
-			}
-		}
-		fclose(fptr);
-		sleep(t);
-	}
-}
-
-/**
- * @brief Prints the number of times the CPU(s) has(ve) been interrupted by the 
- * keyboardcontroller (i8042 with IRQ 1).
- * @details Reads 1st line of info in /proc/interrupts. Infinite loop sleeping
- * in intervals of t.
- */
-void *bw_interrupt(void *interval){
-	int t = *((int*)interval);
-	char *buf = NULL;
-	size_t buf_size = 0;
-	FILE *fptr = fopen("/proc/interrupts", "r");
-	getline(&buf, &buf_size, fptr);
-	printf(buf);
-	fclose(fptr);
-	while(1){
-		FILE *fptr = fopen("/proc/interrupts", "r");
-		bool found = false;
-		int n;
-		while(!found){
-			getline(&buf, &buf_size, fptr);
-			n = strlen(buf);
-			for(int i=0; i<n-2; i++){
-				if(!strncmp(&buf[i], "1:", 2)){
-					buf[i] = buf[i+1] = ' ';
-					found = true;
-					break;
-				}
-			}
-		}
-
-		for(int i=0; i<n; i++){
-			if(isspace(buf[i]) || isdigit(buf[i]))
-				printf("%c", buf[i]);
-			else break;
-		}
-		printf("\n");
-
-		fclose(fptr);
-		sleep(t);
-	}
-	return 0;
-}
-
-/**
- * @brief Prints the pid of the process that was most recently created on the system
- * @details Reads info from the 5th argument in /proc/loadavg. Infinite loop sleeping
- * in intervals of t.
- */
-void *bw_newborn(void *interval){ 
-	int t = *((int*)interval);
-	char buf[4096];
-
-	while(1){
-		int fd = open("/proc/loadavg", O_RDONLY);
-		read(fd, &buf, 4095);
-		char *saveptr, *token;
-
-		token = strtok_r(buf, " ", &saveptr);
-		for(int i=1; i<5; i++)
-			token = strtok_r(NULL, " ", &saveptr);
-		printf(token);
-		close(fd);
-		sleep(t);
-	}
-}
-
-#define BAYWATCH_DIRTY 0
-#define BAYWATCH_INTERRUPT 1
-#define BAYWATCH_NEWBORN 2
-void* (*baywatch_jt[])(void *) = {bw_dirty, bw_interrupt, bw_newborn};
-
-/**
- * @brief Similar to the watch command. Will display last ran thread, dirty memory or
- * interrupts from i8042 with IRQ1 as specified by the flag at intervals of `n` seconds
- * until the key `q` is pressed 
+ * @brief Joins argv[from..argc] of a command back into a command line, with its
+ * I/O redirection appended. Used by builtins that run another command (replay, every, at).
+ * 
+ * @return The command line. Caller must free.
  */
-int baywatch(Command *c){
-
-	// Function must have 3 arguments
-	if(c->argc != 3){
-		throw_error(BAD_ARGS); return -1;
-	}
-
-	// Parse possible locations of `-n` flag
-	int ndex = -1;
-	if(!strncmp(c->argv.arr[1], "-n", 2)) ndex = 1;
-	else if(!strncmp(c->argv.arr[2], "-n", 2)) ndex = 2;
-
-	if(ndex==-1){
-		throw_error(BAD_ARGS); return -1;
-	}
-
-	// Get interval time
-	int interval = string_to_int(c->argv.arr[ndex+1]);
-	if(interval==-1){
-		throw_error(BAD_ARGS); return -1;
+string rebuild_command(Command *c, int from){
+	size_t len = 1;
+	for(int i=from; i<=c->argc; i++)
+		len += strlen(c->argv.arr[i]) + 1;
+	if(c->infile) len += strlen(c->infile) + 4;
+	if(c->outfile) len += strlen(c->outfile) + 5;
+
+	string buf = check_bad_alloc(malloc(len));
+	buf[0] = '\0';
+	for(int i=from; i<=c->argc; i++){
+		if(i > from) strcat(buf, " ");
+		strcat(buf, c->argv.arr[i]);
 	}
-
-	// Parse command type
-	string type = (ndex==1)?c->argv.arr[3]:c->argv.arr[1];
-
-	int COMMAND = -1;
-	if(!strcmp(type, "dirty")) COMMAND = BAYWATCH_DIRTY;
-	else if(!strcmp(type, "interrupt")) COMMAND = BAYWATCH_INTERRUPT;
-	else if(!strcmp(type, "newborn")) COMMAND = BAYWATCH_NEWBORN;
-
-	if(COMMAND==-1) {
-		puts("Invalid command. The options available to you are [dirty, newborn, interrupt].");
-		return -1;
+	if(c->infile){
+		strcat(buf, " < ");
+		strcat(buf, c->infile);
 	}
-
-	// Create a new thread where the watcher will output contents 
-	pthread_t newthread;
-	pthread_create(&newthread, NULL, baywatch_jt[COMMAND], &interval);
-
-	// Enable raw mode so we can setup a listener for the `q` key
-	enableRawMode();
-	char ch;
-	// Check for `q` press
-	while(read(STDIN_FILENO, &ch, 1)==1){
-		if(ch=='q'){
-			pthread_cancel(newthread);
-			break;
-		}
+	if(c->outfile){
+		strcat(buf, (c->append) ? " >> " : " > ");
+		strcat(buf, c->outfile);
 	}
-	// Set terminal back to normal
-	disableRawMode();
-	return 0;
+	return buf;
 }
 
 #define INTERVAL_BIT (1<<0)
@@ -193,9 +97,12 @@ int baywatch(Command *c){
 
 /**
  * @brief Util function for replay parser to parse commands.
+ * @details Isolates the argument after -<flag>, parses it as a (fractional) number 
+ * of seconds into ts and erases both from the command.
+ * 
  * @return 0 on success, -1 on failure.
  */
-int __parse_replay_util(string cmd, int pos, int n, int LEN){
+int __parse_replay_util(string cmd, int pos, int n, int LEN, struct timespec *ts){
 	
 	int num_end, j, ret;
 	// Erase -<flag> from command
@@ -205,11 +112,11 @@ int __parse_replay_util(string cmd, int pos, int n, int LEN){
 	while(j < n && cmd[j]==' ') j++;
 	if(j==n) return -1; // No argument after -<flag>
 	
-	// Isolate the next argument and parse it to an int
+	// Isolate the next argument and parse it to a time interval
 	num_end = j;
 	while(num_end < n && cmd[num_end] != ' ') num_end++;
 	cmd[num_end] = '\0';
-	ret = string_to_int(&cmd[j]);
+	ret = string_to_interval(&cmd[j], ts);
 
 	// Erase the number from the string
 	for(;j<n && j<=num_end; j++) cmd[j] = ' ';
@@ -219,11 +126,11 @@ int __parse_replay_util(string cmd, int pos, int n, int LEN){
 
 /**
  * @brief Parses the arguments given to replay. Stores interval & period in 
- * pointers passed to the two integers
+ * the timespecs passed to it
  * 
  * @return 0 on success, -1 on failure.
  */
-int __parse_replay_args(string cmd, int *interval, int *period){
+int __parse_replay_args(string cmd, struct timespec *interval, struct timespec *period){
 	
 	// Holder vars
 	int n = strlen(cmd);
@@ -234,13 +141,11 @@ int __parse_replay_args(string cmd, int *interval, int *period){
 		if(cmd[i] == '-'){
 			if(!strncmp(&cmd[i], "-interval ", ILEN)){
 				status |= INTERVAL_BIT; 
-				*interval = __parse_replay_util(cmd, i, n, ILEN);
-				if(*interval==-1) return -1;
+				if(__parse_replay_util(cmd, i, n, ILEN, interval) == -1) return -1;
 			}
 			else if(!strncmp(&cmd[i], "-period ", PLEN)){
 				status |= PERIOD_BIT;
-				*period = __parse_replay_util(cmd, i, n, PLEN);
-				if(*period==-1) return -1;
+				if(__parse_replay_util(cmd, i, n, PLEN, period) == -1) return -1;
 			}
 		}
 	}
@@ -263,12 +168,46 @@ int __parse_replay_args(string cmd, int *interval, int *period){
 	else return -1;
 }
 
+/**
+ * @brief Runs the command once per interval, count times
+ * @details Runs are scheduled on a timerfd, whose expirations are absolute 
+ * monotonic deadlines: the time a command takes doesn't push back the later 
+ * runs. Deadlines missed while a command was still running are skipped.
+ * 
+ * @return 0 on success. -1 on failure.
+ */
+int __replay_run(string cmd, struct timespec *interval, int64_t count){
+	int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if(check_perror("replay", tfd, -1)) return -1;
+	struct itimerspec its = {.it_interval = *interval, .it_value = *interval};
+	timerfd_settime(tfd, 0, &its, NULL);
+
+	for(int64_t done = 0; done < count;){
+		uint64_t ticks;
+		if(read(tfd, &ticks, sizeof(ticks)) != sizeof(ticks)){
+			if(errno == EINTR) continue;
+			break;
+		}
+		if((done += ticks) > count) break;
+		parse(cmd);
+		bflush();
+
+		// Reap the commands it ran in the background, a background replay has no SIGCHLD handler
+		if(KSH.background) while(waitpid(-1, NULL, WNOHANG) > 0);
+	}
+	close(tfd);
+	return 0;
+}
+
 /**
  * @brief Executes a particular command in fixed time interval for a certain period.
  * @details Best explained with an example. `replay -command echo "hi" -interval 3 -period 6`
  * This command will execute echo "hi" command after every 3 seconds until 6 seconds are 
  * elapsed. In this example, echo "hi" command will be executed 2 times, once after 3 seconds 
- * and then after 6 seconds.
+ * and then after 6 seconds. Interval and period can be fractional, down to a millisecond.
+ * 
+ * With `&` replay runs in a forked shell that is tracked as a job, so it shows up in
+ * `jobs` and can be stopped with `sig`, while the prompt stays usable.
  *
  * @return 0 on success. -1 on failure.
  */
@@ -282,44 +221,48 @@ int replay(Command *c){
 
 	// For this command specifically, it is easier to parse as a complete string
 	// rather than as individual arguments. So we will re-construct the string from args.
-
-	int req_len = 0;
-	for(int i=1; i<=c->argc; i++)
-		req_len += strlen(c->argv.arr[i]) + 1; // +1 for whitespace
-	req_len++; // Null char
-
-	// Reconstruct string
-	string buf = malloc(sizeof(char)*req_len + 1024);
-	strcpy(buf, c->argv.arr[1]);
-	for(int i=2; i<=c->argc; i++){
-		strcat(buf, " ");
-		strcat(buf, c->argv.arr[i]);
-	}
+	// I/O redirection for command will get stored in c, it goes with the command we will run instead.
+	string buf = rebuild_command(c, 1);
 
 	// Parse arguments
-	int interval, period;
+	struct timespec interval, period;
 	if(__parse_replay_args(buf, &interval, &period) == -1){
+		free(buf);
 		throw_error(BAD_PARSE); return -1;
 	}
-
-	// I/O redirection for command will get stored in c. Append to the command we will run instead.
-	if(c->infile){
-		strcat(buf, " < ");
-		strcat(buf, c->infile);
-	}
-	if(c->outfile){
-		if(c->append) strcat(buf, " >> ");
-		else strcat(buf, " > ");
-		strcat(buf, c->outfile);
-	}
+	int64_t interval_ns = interval.tv_sec * 1000000000LL + interval.tv_nsec;
+	int64_t count = (period.tv_sec * 1000000000LL + period.tv_nsec) / interval_ns;
 
 	// Repeat the command
-	for(int t=interval; t<=period; t+=interval){
-		sleep(interval);
-		parse(buf);
+	if(!c->runInBackground){
+		int ret = __replay_run(buf, &interval, count);
+		free(buf);
+		return ret;
 	}
 
-	// Cleanup
+	// Don't let the child inherit pending builtin output
+	bflush();
+	pid_t pid = fork();
+	if(check_error(FORK_FAIL, pid, -1)){
+		free(buf);
+		return -1;
+	}
+	if(ISCHILD(pid)){
+		// Own process group and default signal handlers, like any background job.
+		// The terminal stays with the shell.
+		setpgid(0, 0);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTSTP, SIG_DFL);
+		signal(SIGCHLD, SIG_DFL);
+		KSH.background = true;
+		int ret = __replay_run(buf, &interval, count);
+		bflush();
+		// Leave without cleanup(), the history and baywatch belong to the shell
+		_exit(ret == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	setpgid(pid, pid);
+	insert_process(pid, c->name, &(KSH.plist.head));
+	bprintf("%d\n", pid);
 	free(buf);
 	return 0;
 }
@@ -348,7 +291,7 @@ int fg(Command *c){
 	// Get process id from the given job number
 	pid_t pid = get_process_id(job_num, &(KSH.plist.head));
 	if(pid == -1){
-		printf("Process with job number %ld does not exist.\n", job_num);
+		bprintf("Process with job number %ld does not exist.\n", job_num);
 		return -1;
 	}
 
@@ -401,7 +344,7 @@ int bg(Command *c){
 	// Get process id from the given job number
 	pid_t pid = get_process_id(job_num, &(KSH.plist.head));
 	if(pid == -1){
-		printf("Process with job number %ld does not exist.\n", job_num); // Handle errors
+		bprintf("Process with job number %ld does not exist.\n", job_num); // Handle errors
 		return -1;
 	}
 
@@ -439,7 +382,7 @@ int sig(Command *c){
 	// Gets pid of process
 	pid_t pid = get_process_id(job_num, &(KSH.plist.head));
 	if(pid == -1){
-		printf("Process with job number %ld does not exist.\n", job_num); // Handle errors
+		bprintf("Process with job number %ld does not exist.\n", job_num); // Handle errors
 		return -1;
 	}
 
@@ -450,6 +393,7 @@ int sig(Command *c){
 
 #define JOBS_BIT_R (1<<0)
 #define JOBS_BIT_S (1<<1)
+#define JOBS_BIT_V (1<<2)
 #define INCLUDE_RUNNING(X) (X & JOBS_BIT_R)
 #define INCLUDE_STOPPED(X) (X & JOBS_BIT_S)
 #define IS_STOPPED(X) (X!='R' && X!='S')
@@ -457,7 +401,8 @@ int sig(Command *c){
 
 /**
  * @brief Util function to parse arguments given to 'jobs' command
- * @details Checks for the -r and -s flags and toggles appropriate bits in flags
+ * @details Checks for the -r, -s and -v flags and toggles appropriate bits in flags.
+ * Without -r or -s all jobs are included.
  * 
  * @return 0 on success, -1 if bad args are encountered
  */
@@ -482,6 +427,9 @@ int __jobs_parse_arguments(Command *c, uint8_t *flags){
 					case 's':
 						f |= JOBS_BIT_S; // Include sleeping jobs
 					break;
+					case 'v':
+						f |= JOBS_BIT_V; // Resource usage
+					break;
 					default:
 						throw_error(BAD_PARSE);
 						return -1;
@@ -493,17 +441,34 @@ int __jobs_parse_arguments(Command *c, uint8_t *flags){
 			return -1;
 		}
 	}
+	if(!INCLUDE_RUNNING(f) && !INCLUDE_STOPPED(f)) f |= JOBS_BIT_R | JOBS_BIT_S;
 	*flags = f;
 	return 0;
 }
 
 /**
- * @brief Case insensitive comparator function for sorting jobs by name
+ * @brief jobs -v. Prints the resource usage of the jobs selected by flags, sorted by name
  */
-int jobs_cmp(const void *a, const void *b){
-	job *p = (job*) a;
-	job *q = (job*) b;
-	return strcasecmp(p->name, q->name);
+void __jobs_verbose(uint8_t flags){
+	job_stats *stats;
+	uint32_t n = jobmon_sample(&stats), kept = 0;
+	for(uint32_t i=0; i<n; i++){
+		char status = stats[i].state;
+		if((IS_RUNNING(status) && INCLUDE_RUNNING(flags)) || (IS_STOPPED(status) && INCLUDE_STOPPED(flags)))
+			stats[kept++] = stats[i];
+		else
+			free(stats[i].name);
+	}
+
+	string *names = check_bad_alloc(malloc(max(kept, 1) * sizeof(string)));
+	for(uint32_t i=0; i<kept; i++) names[i] = stats[i].name;
+	uint32_t *perm = sort_names(names, kept, CASE_INSENSITIVE_SORT);
+	apply_permutation(stats, sizeof(job_stats), perm, kept);
+	free(perm);
+	free(names);
+
+	jobmon_print(&KSH.out, stats, kept);
+	jobmon_free(stats, kept);
 }
 
 /**
@@ -512,37 +477,32 @@ int jobs_cmp(const void *a, const void *b){
  * @details Accepts flags -r and -s for including running and sleeping processes
  * respectively. Job number is a sequential number for jobs dispatched by the shell
  * and can be used to uniquely identify processes started by the current instaance of 
- * the shell
+ * the shell. With -v, prints the CPU%, RSS, disk i/o, threads and state of each job.
  */
 int jobs(Command *c){
 	// Read flag arguments
 	uint8_t flags = 0;
 	if(__jobs_parse_arguments(c, &flags)==-1) return -1;
 
+	if(flags & JOBS_BIT_V){
+		__jobs_verbose(flags);
+		return 0;
+	}
+
 	// Allocate enough space for array to hold the jobs and init iterator vars
 	uint32_t list_size = KSH.plist.size(&KSH.plist);
-	job *jlist = check_bad_alloc(calloc(list_size, sizeof(job)));
-	char buf[4096];
+	job *jlist = check_bad_alloc(calloc(max(list_size, 1), sizeof(job)));
 	uint32_t jdex = 0;
-	int fd = -1;
+	proc_stat st;
 
 	// Pointer to head of proc list
 	Process *p = KSH.plist.head;
 	for(; p; p=p->next){
-		// Query the /proc/pid/stat file for information regarding execution state
-		sprintf(buf, "/proc/%d/stat", p->id);
-		if(check_perror("Jobs", fd = open(buf, O_RDONLY), -1)) continue;
-		if(check_perror("Jobs", read(fd, buf, 4096), -1)) continue;
-		
-		// Iterate through contents to get the STAT_STATUS argument
-		char *saveptr, status;
-		char *token = strtok_r(buf, " ", &saveptr);
-		for(int argno=1; token; token=strtok_r(NULL, " ", &saveptr), argno++){
-			if(argno==STAT_STATUS){
-				status = token[0];
-				break;
-			}
-		}
+		// Query the /proc/pid/stat file for information regarding execution state.
+		// The fd is kept with the job for later queries.
+		if(check_perror("Jobs", jobmon_open(&p->stat_fd, p->id, "stat"), -1)) continue;
+		if(check_perror("Jobs", procfs_read_stat(p->stat_fd, &st, PS_STATE), -1)) continue;
+		char status = st.state;
 		
 		// Include in array if flags agree with state
 		if((IS_RUNNING(status) && INCLUDE_RUNNING(flags)) || (IS_STOPPED(status) && INCLUDE_STOPPED(flags))){
@@ -551,20 +511,20 @@ int jobs(Command *c){
 			jlist[jdex].pid = p->id;
 			jlist[jdex++].status = status;
 		}
-
-		// Close file
-		check_perror("Jobs", close(fd), -1);
 	}
 
 	// Sort list by name
-	qsort(jlist, jdex, sizeof(job), jobs_cmp);
+	string *names = check_bad_alloc(malloc(max(jdex, 1) * sizeof(string)));
+	for(int i=0; i<jdex; i++) names[i] = jlist[i].name;
+	uint32_t *perm = sort_names(names, jdex, CASE_INSENSITIVE_SORT);
+	apply_permutation(jlist, sizeof(job), perm, jdex);
+	free(perm);
+	free(names);
 
 	// Print the list
 	for(int i=0; i<jdex; i++){
-		printf("[%ld] ", jlist[i].job_num);
-		printf("%s ", ((IS_STOPPED(jlist[i].status))?"Stopped":"Running"));
-		printf("%s ", jlist[i].name);
-		printf("[%d]\n", jlist[i].pid);
+		bprintf("[%ld] %s %s [%d]\n", jlist[i].job_num, ((IS_STOPPED(jlist[i].status))?"Stopped":"Running"),
+				jlist[i].name, jlist[i].pid);
 	}
 
 	// Cleanup
@@ -594,17 +554,26 @@ int history(Command *c){
 
 	// Handle bad args
 	if(toshow <= 0){
-		printf("Number must be between 1 and 20.\n"); 
+		bprintf("Number must be between 1 and 20.\n"); 
 		return -1;
 	}
 
 	// Print history
 	for(int i=toshow-1; i>=0; i--){
-		printf("%s\n", KSH.history.data[i]);
+		bprintf("%s\n", KSH.history.data[i]);
 	}
 	return 0;
 }
 
+/**
+ * @brief The `+` / `-` suffix of a process status, `+` if it's in the foreground process group
+ * @param fg The foreground process group, from tcgetpgrp. Passed in so callers printing
+ * many processes only query it once.
+ */
+char pinfo_activity(const proc_stat *st, pid_t fg){
+	return (st->pgrp == fg) ? '+':'-';
+}
+
 /**
  * @brief Display process information
  * @details Reads data from /proc/pid/stat and /proc/pid/exe to display
@@ -630,99 +599,294 @@ int pinfo(Command *c){
 	}
 
 	// We will query /proc/pid/stat to get process information
-	int reqlen = 1024; // strlen("/proc/x/stat")
-	string query = malloc(reqlen);
-	sprintf(query, "/proc/%d/stat", pid);
-
-	// Open /proc/pid/stat
-	int fd = open(query, O_RDONLY);
+	int fd = procfs_open(pid, "stat");
 	if(fd < 0){
-		printf("Program with pid: %d doesn't exist\n", pid);
+		bprintf("Program with pid: %d doesn't exist\n", pid);
 		return -1;
 	}
-	// Read data to buf
-	string buf = malloc(1024*8);
-	if(check_perror("pinfo", read(fd, buf, 1024*8), -1)) return -1;
-
-	// Setup variables to store the data retrieved
-	char status;
-	int64_t memory_used = 0;
-	char status_activity;
-	pid_t pgrp_id = 0;
-
-	// Go through every token in data retrieved from proc, save relevant info
-	char *saveptr;
-	char *token = strtok_r(buf, " ", &saveptr);
-	for(int argno=1; token; token=strtok_r(NULL, " ", &saveptr), argno++){
-		if(argno==STAT_STATUS) status = token[0];
-		if(argno==STAT_PGRPID) pgrp_id = string_to_int(token);
-		if(argno==STAT_VMSIZE) { memory_used = string_to_int(token); break; }
+	proc_stat st;
+	int ret = procfs_read_stat(fd, &st, PS_STATE | PS_PGRP | PS_VSIZE);
+	if(check_perror("pinfo", close(fd), -1)) return -1;
+	if(ret == -1){
+		bprintf("Program with pid: %d doesn't exist\n", pid);
+		return -1;
 	}
 
-	// If pgrpid == foreground group id, set foreground process
-	status_activity = (pgrp_id==tcgetpgrp(0)) ? '+':'-';
+	char status_activity = pinfo_activity(&st, tcgetpgrp(0));
 
 	// Query /proc/exe for executable path. Handle symlink
+	char query[64], exe[PATH_MAX];
+	string path = exe;
 	sprintf(query, "/proc/%d/exe", pid);
-	int readlen = readlink(query, buf, 1024*8);
-	buf[readlen] = 0;
-	reverse_replace_tilda(&buf);
+	ssize_t readlen = readlink(query, exe, PATH_MAX - 1);
+	if(readlen == -1) strcpy(exe, "-");
+	else exe[readlen] = 0;
+	reverse_replace_tilda(&path);
 
 	// Print relevant info
-	printf("pid -- %d\n", pid);
-    printf("Process Status -- %c%c\n", status, status_activity);
-    printf("memory -- %ldB\n", memory_used);
-    printf("Executable Path -- %s\n", buf);
+	bprintf("pid -- %d\n", pid);
+    bprintf("Process Status -- %c%c\n", st.state, status_activity);
+    bprintf("memory -- %luB\n", st.vsize);
+    bprintf("Executable Path -- %s\n", exe);
+	return 0;
+}
 
-    // Cleanup
-	free(buf);
-	free(query);
+int64_t repeat_now_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
 
-	// Close file
-	if(check_perror("pinfo", close(fd), -1)) return -1;
-	return 0;
+/**
+ * @brief Adds one iteration to the stats. ru is NULL for builtins.
+ * @details Wall times are kept until there are REPEAT_SAMPLES of them, after that
+ * each one replaces a kept one with probability REPEAT_SAMPLES / n (reservoir sampling).
+ */
+void repeat_record(repeat_stats *s, int64_t wall_ns, int code, struct rusage *ru){
+	s->sum += wall_ns;
+	if(!s->n || wall_ns < s->min) s->min = wall_ns;
+	if(!s->n || wall_ns > s->max) s->max = wall_ns;
+	s->n++;
+	if(s->kept < REPEAT_SAMPLES){
+		if(s->kept == s->cap){
+			s->cap = s->cap ? s->cap * 2 : 256;
+			s->wall = check_bad_alloc(realloc(s->wall, s->cap * sizeof(int64_t)));
+		}
+		s->wall[s->kept++] = wall_ns;
+	}
+	else{
+		// xorshift64, seeded on the first replacement
+		if(!s->rng) s->rng = repeat_now_ns() | 1;
+		s->rng ^= s->rng << 13;
+		s->rng ^= s->rng >> 7;
+		s->rng ^= s->rng << 17;
+		uint64_t j = s->rng % s->n;
+		if(j < REPEAT_SAMPLES) s->wall[j] = wall_ns;
+	}
+	s->codes[code & (REPEAT_CODES - 1)]++;
+	if(ru){
+		s->utime_us += ru->ru_utime.tv_sec * 1000000LL + ru->ru_utime.tv_usec;
+		s->stime_us += ru->ru_stime.tv_sec * 1000000LL + ru->ru_stime.tv_usec;
+	}
+}
+
+int __cmp_int64(const void *a, const void *b){
+	int64_t x = *(const int64_t*) a, y = *(const int64_t*) b;
+	return (x > y) - (x < y);
+}
+
+void __repeat_print_ms(const char *label, int64_t ns){
+	bprintf("  %s %ld.%03ld", label, ns / 1000000, ns / 1000 % 1000);
+}
+
+/**
+ * @brief Prints min / mean / p50 / p99 / max wall time, mean CPU time per run 
+ * (from rusage) and how many runs exited with each code
+ */
+void repeat_print_stats(repeat_stats *s, int64_t total_ns, int64_t parallel){
+	if(!s->n) return;
+	qsort(s->wall, s->kept, sizeof(int64_t), __cmp_int64);
+
+	bprintf("%lu runs, %ld at a time, %ld.%03lds total\n", s->n, parallel, total_ns / 1000000000LL, 
+			total_ns / 1000000 % 1000);
+	bprintf("wall (ms)");
+	__repeat_print_ms("min", s->min);
+	__repeat_print_ms("mean", s->sum / (int64_t) s->n);
+	// Nearest rank percentiles
+	__repeat_print_ms("p50", s->wall[(s->kept * 50 + 99) / 100 - 1]);
+	__repeat_print_ms("p99", s->wall[(s->kept * 99 + 99) / 100 - 1]);
+	__repeat_print_ms("max", s->max);
+	bprintf("\n");
+	if(s->rusage){
+		bprintf("cpu (ms/run)");
+		__repeat_print_ms("user", s->utime_us * 1000 / (int64_t) s->n);
+		__repeat_print_ms("sys", s->stime_us * 1000 / (int64_t) s->n);
+		bprintf("\n");
+	}
+	bprintf("exit codes");
+	for(int code=0; code<REPEAT_CODES; code++)
+		if(s->codes[code]) bprintf("  %d: %lu", code, s->codes[code]);
+	bprintf("\n");
+}
+
+/**
+ * @brief Runs n copies of a system command, at most parallel at a time
+ * @details All copies share one process group, which gets the terminal, so ctrl-c
+ * reaches every running copy (and stops launching new ones). The group is led by a
+ * placeholder process that only waits to be killed: it keeps the group valid for
+ * copies launched after the first ones were reaped. SIGCHLD is blocked throughout
+ * and copies are reaped with wait4 on the group, which also yields their rusage.
+ * The batch can't be suspended, stopped copies are continued.
+ *
+ * @param s Stats to fill, NULL if not wanted
+ * @return 0 on success, -1 on failure
+ */
+int __repeat_parallel(Command *package, int64_t n, int64_t parallel, repeat_stats *s){
+	sigset_t mask, old;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, &old);
+
+	bflush();
+	pid_t leader = fork();
+	if(check_error(FORK_FAIL, leader, -1)){
+		sigprocmask(SIG_SETMASK, &old, NULL);
+		return -1;
+	}
+	if(ISCHILD(leader)){
+		setpgid(0, 0);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTSTP, SIG_DFL);
+		while(true) pause();
+	}
+	setpgid(leader, leader);
+	make_fg_process(leader);
+
+	pid_t *pids = check_bad_alloc(calloc(parallel, sizeof(pid_t)));
+	int64_t *start = check_bad_alloc(calloc(parallel, sizeof(int64_t)));
+	int64_t launched = 0, running = 0;
+	bool stop = false, leader_alive = true;
+	int ret = 0;
+	while(running || (!stop && launched < n)){
+		for(int64_t slot=0; !stop && launched < n && running < parallel; slot++){
+			if(pids[slot]) continue;
+			pid_t pid = spawn_command(package, leader);
+			if(pid == -1){
+				stop = true;
+				ret = -1;
+				break;
+			}
+			pids[slot] = pid;
+			start[slot] = repeat_now_ns();
+			running++;
+			launched++;
+		}
+		if(!running) break;
+
+		int status;
+		struct rusage ru;
+		pid_t pid = wait4(-leader, &status, WUNTRACED, &ru);
+		if(pid == -1){
+			if(errno == EINTR) continue;
+			break;
+		}
+		if(WIFSTOPPED(status)){
+			kill(-leader, SIGCONT);
+			continue;
+		}
+		if(pid == leader){
+			// Killed from the terminal, along with the running copies
+			leader_alive = false;
+			stop = true;
+			continue;
+		}
+
+		int64_t slot = 0;
+		while(slot < parallel && pids[slot] != pid) slot++;
+		if(slot == parallel) continue;
+		pids[slot] = 0;
+		running--;
+		if(WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) stop = true;
+		if(s) repeat_record(s, repeat_now_ns() - start[slot], 
+							  WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status), &ru);
+	}
+
+	if(leader_alive){
+		kill(leader, SIGKILL);
+		waitpid(leader, NULL, 0);
+	}
+	make_fg_parent();
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	free(start);
+	free(pids);
+	return ret;
 }
 
 /**
  * @brief Repeats the command given to it 'n' times
+ * @details Usage: `repeat [-P N] [--stats] n command args...`. `-P N` runs up to N
+ * copies of a system command at a time (builtins always run one after another).
+ * `--stats` reports min / mean / p50 / p99 / max wall time, CPU time per run and 
+ * the distribution of exit codes once all iterations are done.
  * 
  * @return -1 on failure. 0 on success.
  */
 int repeat(Command *c){
+	// Options come before 'n'
+	int argi = 1;
+	int64_t parallel = 1;
+	bool stats = false;
+	while(argi <= c->argc && c->argv.arr[argi][0] == '-'){
+		if(!strcmp(c->argv.arr[argi], "-P") && argi < c->argc){
+			parallel = string_to_int(c->argv.arr[++argi]);
+			if(parallel <= 0){
+				throw_error(BAD_ARGS); return -1;
+			}
+		}
+		else if(!strcmp(c->argv.arr[argi], "--stats")) stats = true;
+		else break;
+		argi++;
+	}
+
 	// Usage: repeat 'n' command-name args...
-	if(c->argc <= 1){
+	if(c->argc <= argi){
 		throw_error(TOO_LESS_ARGS);
 		return -1;
 	}
 	// Convert 'n' to int type
-	int64_t n = string_to_int(c->argv.arr[1]);
+	int64_t n = string_to_int(c->argv.arr[argi]);
 	// Cannot repeat < 0 times
 	if(n <= 0){
-		puts("Please provide a valid integer > 0 after repeat");
+		bputs("Please provide a valid integer > 0 after repeat");
 		return 0;
 	}
 	
 	// Obtain comand to be repeated from args passed to repeat
 	Command package;
-	init_command(&package, c->argv.arr[2]);
-	for(int i=3; i<=c->argc; i++){
+	init_command(&package, c->argv.arr[argi + 1]);
+	for(int i=argi + 2; i<=c->argc; i++){
 		push_back(&(package.argv), c->argv.arr[i]);
 		package.argc++;
 	}
-	if(!is_builtin(package.name)) push_back(&(package.argv), NULL);
+	bool builtin = (package.builtin != -1);
+	if(!builtin) push_back(&(package.argv), NULL);
 	if(c->infile)
 		package.infile = check_bad_alloc(strdup(c->infile));
 	if(c->outfile)
 		package.outfile = check_bad_alloc(strdup(c->outfile));
 	package.append = c->append;
 
+	repeat_stats s;
+	memset(&s, 0, sizeof(repeat_stats));
+	int64_t begin = repeat_now_ns();
+	int ret = 0;
+
 	// Execute the command in a loop n times
-	for(int i=0; i<n; i++)
-		execute(&package);
+	if(builtin || (parallel == 1 && !stats)){
+		for(int64_t i=0; i<n; i++){
+			int64_t t = repeat_now_ns();
+			int status = execute(&package);
+			if(stats) repeat_record(&s, repeat_now_ns() - t, (status == -1) ? 1 : status, NULL);
+		}
+		parallel = 1;
+	}
+	// Copies run concurrently, redirect once for all of them
+	else if(setup_redirection(&package) == 0){
+		s.rusage = true;
+		ret = __repeat_parallel(&package, n, parallel, stats ? &s : NULL);
+		cleanup_redirection();
+	}
+	else{
+		cleanup_redirection();
+		ret = -1;
+	}
+
+	if(stats) repeat_print_stats(&s, repeat_now_ns() - begin, parallel);
 
 	// Cleanup
+	free(s.wall);
 	destroy_command(&package);
-	return 0;
+	return ret;
 }
 
 
@@ -734,8 +898,8 @@ int repeat(Command *c){
  */
 int echo(Command *c){
 	for(int i=1; i<=c->argc; i++)
-		check_error(PRINTF_FAIL, printf("%s ", c->argv.arr[i]), -1);
-	check_error(PRINTF_FAIL, printf("\n"), -1);
+		check_error(PRINTF_FAIL, bprintf("%s ", c->argv.arr[i]), -1);
+	check_error(PRINTF_FAIL, bprintf("\n"), -1);
 	return 0;
 }
 
@@ -749,7 +913,7 @@ int pwd(Command *c){
 		throw_error(TOO_MANY_ARGS);
 		return -1;
 	}
-	puts(KSH.curdir);
+	bputs(KSH.curdir);
 	return 0;
 }
 
@@ -786,7 +950,7 @@ int cd(Command *c){
 	struct stat sb;
 	if(check_perror("cd", stat(newpath, &sb), -1)) return -1;
 	if(!S_ISDIR(sb.st_mode)){
-		puts("cd: Cannot cd to a file. Path must be a directory.");
+		bputs("cd: Cannot cd to a file. Path must be a directory.");
 		return -1;
 	}
 
@@ -4,13 +4,13 @@
 void cprintf(string FG, string BG, string format, ...){
 	
 	// Set foreground Bitand background colors
-	if(FG) printf(FG);
-	if(BG) printf(BG);
+	if(FG) buf_write(&KSH.out, FG, strlen(FG));
+	if(BG) buf_write(&KSH.out, BG, strlen(BG));
 
 	// Print format string
 	va_list args;
 	va_start(args, format);
-	vprintf(format, args);
+	buf_vprintf(&KSH.out, format, args);
 	va_end(args);
 
 	// Reset to default
@@ -32,8 +32,7 @@ void csprintf(char *buf, string FG, string BG, string format, ...){
 }
 
 void __reset_tty_colors(){
-	printf(TTY_RESET);
-	printf(FG_WHITE);
+	buf_write(&KSH.out, TTY_RESET FG_WHITE, strlen(TTY_RESET FG_WHITE));
 }
 
 void __thread_safe_reset_tty(){
@@ -0,0 +1,375 @@
+#include "libs.h"
+#include "du.h"
+
+#define BIT_S (1<<0)
+#define BIT_H (1<<1)
+#define BIT_X (1<<2)
+#define SUMMARIZE(X) (X & BIT_S)
+#define HUMAN_READABLE(X) (X & BIT_H)
+#define ONE_FS(X) (X & BIT_X)
+
+typedef struct du_walk{
+	int flags;
+	int64_t max_depth;
+	inode_set seen;
+	int ret;
+} du_walk;
+
+// -------------------------------- Util functions --------------------------------
+
+void __create_inode_set(inode_set *s){
+	for(int i=0; i<INODE_SHARDS; i++){
+		s->shards[i].table_size = 64;
+		s->shards[i].size = 0;
+		s->shards[i].table = check_bad_alloc(calloc(64, sizeof(inode_key)));
+		pthread_mutex_init(&s->shards[i].lock, NULL);
+	}
+}
+
+void __destroy_inode_set(inode_set *s){
+	for(int i=0; i<INODE_SHARDS; i++){
+		free(s->shards[i].table);
+		pthread_mutex_destroy(&s->shards[i].lock);
+	}
+}
+
+uint64_t __inode_hash(dev_t dev, ino_t ino){
+	uint64_t h = (ino ^ ((uint64_t) dev << 32)) * 0x9E3779B97F4A7C15ull;
+	return h ^ (h >> 29);
+}
+
+/**
+ * @brief Returns the slot of (dev, ino) in the shard, or the empty slot it belongs in.
+ * Empty slots have ino 0, which no file has.
+ */
+inode_key* __inode_slot(inode_shard *s, dev_t dev, ino_t ino, uint64_t h){
+	uint32_t i = h & (s->table_size - 1);
+	while(s->table[i].ino && (s->table[i].ino != ino || s->table[i].dev != dev))
+		i = (i + 1) & (s->table_size - 1);
+	return &s->table[i];
+}
+
+/**
+ * @brief Inserts (dev, ino) into the set. Safe to call from multiple threads.
+ * @return true if it was inserted, false if it was already present
+ */
+bool __inode_insert(inode_set *set, dev_t dev, ino_t ino){
+	uint64_t h = __inode_hash(dev, ino);
+	inode_shard *s = &set->shards[(h >> 58) % INODE_SHARDS];
+	pthread_mutex_lock(&s->lock);
+
+	inode_key *slot = __inode_slot(s, dev, ino, h);
+	bool inserted = !slot->ino;
+	if(inserted){
+		slot->dev = dev;
+		slot->ino = ino;
+		// Keep the load factor under 1/2
+		if(++s->size * 2 > s->table_size){
+			inode_key *old = s->table;
+			uint32_t old_size = s->table_size;
+			s->table_size <<= 1;
+			s->table = check_bad_alloc(calloc(s->table_size, sizeof(inode_key)));
+			for(uint32_t i=0; i<old_size; i++)
+				if(old[i].ino) *__inode_slot(s, old[i].dev, old[i].ino, __inode_hash(old[i].dev, old[i].ino)) = old[i];
+			free(old);
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+	return inserted;
+}
+
+/**
+ * @brief Adds a hard linked file to the node's list, see __du_charge_links
+ */
+void __du_add_link(walk_node *node, struct stat *sb){
+	inode_list *l = node->data;
+	if(!l) l = node->data = check_bad_alloc(calloc(1, sizeof(inode_list)));
+	if(l->size == l->table_size){
+		l->table_size = max(8, l->table_size << 1);
+		l->arr = check_bad_alloc(realloc(l->arr, l->table_size * sizeof(inode_ref)));
+	}
+	l->arr[l->size++] = (inode_ref){sb->st_dev, sb->st_ino, sb->st_blocks};
+}
+
+/**
+ * @brief Formats a size given in 1K blocks like `du -h` does (4.0K, 12M, 1.5G)
+ */
+void __human_size(char *buf, int64_t kb){
+	if(!kb){
+		strcpy(buf, "0");
+		return;
+	}
+	const char units[] = "KMGTPE";
+	double v = kb;
+	int unit = 0;
+	while(v >= 1024 && unit < 5){
+		v /= 1024;
+		unit++;
+	}
+
+	// Round up, with one decimal for single digit sizes
+	if(v < 10){
+		int64_t tenths = v * 10;
+		if(tenths < v * 10) tenths++;
+		if(tenths < 100){
+			sprintf(buf, "%ld.%ld%c", tenths / 10, tenths % 10, units[unit]);
+			return;
+		}
+	}
+	int64_t whole = v;
+	if(whole < v) whole++;
+	sprintf(buf, "%ld%c", whole, units[unit]);
+}
+
+/**
+ * @brief Prints the usage of a path, in 1K blocks or human readable
+ */
+void __print_usage(int flags, int64_t blocks, string path){
+	if(HUMAN_READABLE(flags)){
+		char buf[32];
+		__human_size(buf, blocks >> 1);
+		bprintf("%s\t%s\n", buf, path);
+	}
+	else
+		bprintf("%ld\t%s\n", blocks >> 1, path);
+}
+
+/**
+ * @brief Parses arguments given to du
+ * @details Sets the flags and max depth. Pushes all paths into paths.
+ * 
+ * @return 0 on success, -1 if bad args are encountered
+ */
+int __du_parse_arguments(Command *c, string_vector *paths, int *FLAG, int64_t *max_depth){
+	int flags = 0;
+	*max_depth = -1;
+
+	for(int i=1; i<=c->argc; i++){
+		string arg = c->argv.arr[i];
+		if(!strncmp(arg, "--max-depth", 11)){
+			// Accept both --max-depth=N and --max-depth N
+			string num = NULL;
+			if(arg[11] == '=') num = &arg[12];
+			else if(!arg[11] && i < c->argc) num = c->argv.arr[++i];
+			if(!num || (*max_depth = string_to_int(num)) == -1){
+				throw_error(BAD_ARGS);
+				return -1;
+			}
+		}
+		else if(arg[0] == '-' && arg[1]){
+			for(char *ptr = arg + 1; *ptr; ptr++){
+				switch(*ptr){
+					case 's': flags |= BIT_S; break;
+					case 'h': flags |= BIT_H; break;
+					case 'x': flags |= BIT_X; break;
+					default:
+						throw_error(BAD_FLAGS);
+						return -1;
+				}
+			}
+		}
+		else
+			push_back(paths, arg);
+	}
+
+	if(SUMMARIZE(flags)){
+		if(*max_depth > 0){
+			throw_error(BAD_ARGS);
+			return -1;
+		}
+		*max_depth = 0;
+	}
+	*FLAG = flags;
+	return 0;
+}
+
+// -------------------------------- Walker callbacks --------------------------------
+
+/**
+ * @brief Walker visitor for du. Runs on a worker thread.
+ * @details Stats every entry of the directory relative to its fd and adds up the
+ * blocks of everything that is not a directory. Hard linked files are left to
+ * __du_charge_links. Subdirectories become children carrying their own
+ * blocks, their contents are added when they are visited. The directory is opened 
+ * relative to its parent's fd, which the last child to be visited closes. Entries
+ * that can't be stat'd are reported through the node's buffer.
+ */
+void __du_visit(walker *w, walk_node *node){
+	du_walk *state = w->arg;
+	walk_node *parent = node->parent;
+	int fd;
+	if(parent){
+		fd = openat(parent->fd, strrchr(node->path, '/') + 1, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+		if(__atomic_sub_fetch(&parent->unvisited, 1, __ATOMIC_ACQ_REL) == 0){
+			close(parent->fd);
+			parent->fd = -1;
+		}
+	}
+	else fd = open(node->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+	if(fd == -1){
+		node->err = errno;
+		return;
+	}
+
+	// Roots account for their own blocks and pin the filesystem for -x
+	if(!node->depth){
+		struct stat sb;
+		if(fstat(fd, &sb) == -1){
+			node->err = errno;
+			close(fd);
+			return;
+		}
+		node->blocks = sb.st_blocks;
+		node->dev = sb.st_dev;
+	}
+
+	// The stream gets its own fd, fd is kept for the children
+	int dfd = dup(fd);
+	DIR *d = (dfd == -1) ? NULL : fdopendir(dfd);
+	if(!d){
+		node->err = errno;
+		if(dfd != -1) close(dfd);
+		close(fd);
+		return;
+	}
+
+	struct dirent *dir;
+	struct stat sb;
+	errno = 0;
+	while((dir = readdir(d))){
+		if(!strcmp(dir->d_name, ".") || !strcmp(dir->d_name, "..")) continue;
+		if(fstatat(fd, dir->d_name, &sb, AT_SYMLINK_NOFOLLOW) == -1){
+			buf_printf(&node->out, "du: cannot access '%s/%s': %s\n", node->path, dir->d_name, strerror(errno));
+			errno = 0;
+			continue;
+		}
+		if(ONE_FS(state->flags) && sb.st_dev != node->dev) continue;
+
+		if(S_ISDIR(sb.st_mode)){
+			walk_node *child = walk_add_child(node, dir->d_name);
+			child->blocks = sb.st_blocks;
+			child->dev = node->dev;
+		}
+		else if(sb.st_nlink < 2) node->blocks += sb.st_blocks;
+		else __du_add_link(node, &sb);
+		errno = 0;
+	}
+	if(errno) node->err = errno;
+	closedir(d);
+	if(node->nchildren){
+		node->unvisited = node->nchildren;
+		node->fd = fd;
+	}
+	else close(fd);
+
+	// Output order is independent of the directory order
+	if(node->nchildren > 1){
+		string *names = check_bad_alloc(malloc(node->nchildren * sizeof(string)));
+		for(uint32_t i=0; i<node->nchildren; i++) names[i] = node->children[i]->path;
+		uint32_t *perm = sort_names(names, node->nchildren, CASE_SENSITIVE_SORT);
+		apply_permutation(node->children, sizeof(walk_node*), perm, node->nchildren);
+		free(perm);
+		free(names);
+	}
+}
+
+/**
+ * @brief Walker callback for du. Called on each directory in depth first order.
+ * @details Counts the hard linked files of the directory that no earlier one had.
+ * Workers visit directories in any order, so this is left to the calling thread
+ * for every link to be charged to the same directory on every run.
+ */
+void __du_charge_links(walker *w, walk_node *node){
+	du_walk *state = w->arg;
+	inode_list *l = node->data;
+	if(!l) return;
+	for(uint32_t i=0; i<l->size; i++)
+		if(__inode_insert(&state->seen, l->arr[i].dev, l->arr[i].ino))
+			node->blocks += l->arr[i].blocks;
+	free(l->arr);
+	free(l);
+	node->data = NULL;
+}
+
+/**
+ * @brief Walker callback for du. Called once the whole subtree of node is done.
+ * @details Adds the total of the directory to its parent and prints it if it is
+ * within the max depth. Errors met in the directory are printed first and make
+ * du fail.
+ */
+void __du_emit(walker *w, walk_node *node){
+	du_walk *state = w->arg;
+	if(node->out.used){
+		bflush();
+		check_perror("du", write(STDERR_FILENO, node->out.buf, node->out.used), -1);
+		state->ret = -1;
+	}
+	if(node->err){
+		state->ret = -1;
+		errno = node->err;
+		string buf = check_bad_alloc(malloc(strlen(node->path) + 32));
+		sprintf(buf, "du: cannot read '%s'", node->path);
+		check_perror(buf, -1, -1);
+		free(buf);
+	}
+	if(node->parent) node->parent->blocks += node->blocks;
+	if(state->max_depth == -1 || node->depth <= state->max_depth)
+		__print_usage(state->flags, node->blocks, node->path);
+}
+
+// -------------------------------- Builtin --------------------------------
+
+/**
+ * @brief Builtin implementation of du
+ * @details Usage: `du [-shx] [--max-depth=N] [paths...]`. Reports the disk usage of 
+ * each directory in 1K blocks (human readable with -h). -s only reports the totals of
+ * the paths, -x skips directories on other filesystems. Hard links are counted once,
+ * in the first directory (depth first, names sorted) that has them.
+ * Directories are traversed in parallel by the tree walker.
+ * 
+ * @return 0 on success. -1 on failure.
+ */
+int du(Command *c){
+	du_walk state;
+	string_vector paths;
+	create_vector(&paths, 2);
+	if(__du_parse_arguments(c, &paths, &state.flags, &state.max_depth) == -1){
+		destroy_vector(&paths);
+		return -1;
+	}
+	if(!paths.size) push_back(&paths, ".");
+	__create_inode_set(&state.seen);
+	state.ret = 0;
+
+	int ret = 0;
+	for(int i=0; i<paths.size; i++){
+		struct stat sb;
+		if(lstat(paths.arr[i], &sb) == -1){
+			string buf = check_bad_alloc(malloc(strlen(paths.arr[i]) + 32));
+			sprintf(buf, "du: cannot access '%s'", paths.arr[i]);
+			check_perror(buf, -1, -1);
+			free(buf);
+			ret = -1;
+			continue;
+		}
+
+		// Files are reported as is
+		if(!S_ISDIR(sb.st_mode)){
+			if(sb.st_nlink < 2 || __inode_insert(&state.seen, sb.st_dev, sb.st_ino))
+				__print_usage(state.flags, sb.st_blocks, paths.arr[i]);
+			continue;
+		}
+
+		walker w = {0};
+		w.visit = __du_visit;
+		w.pre = __du_charge_links;
+		w.post = __du_emit;
+		w.arg = &state;
+		walk_tree(&w, &paths.arr[i], 1);
+	}
+
+	// Cleanup
+	__destroy_inode_set(&state.seen);
+	destroy_vector(&paths);
+	return (state.ret == -1) ? -1 : ret;
+}
@@ -3,6 +3,8 @@
  * easy to throw and handle errors appropriately and from a central
  * location. 
  * Fatal errors can be identified quickly. Fatal errors exit the shell.
+ * A background shell (embedded, or a fork of one) leaves with _exit instead:
+ * the atexit handlers are the host's, not its own.
  * Custom error messages are stored in c_errlist.
  */
 
@@ -23,10 +25,23 @@ char *c_errlist[11] = {
 						"KSH: Incorrect arguments passed to program.",
 						"KSH: Bad command. Parsing error."};
 
+/**
+ * @brief Exits the process, without the atexit handlers in a background shell
+ */
+void __fatal_exit(int code){
+	if(KSH.background){
+		fflush(stdout);
+		_exit(code);
+	}
+	exit(code);
+}
+
 // Fatal errors exit the process
+// Pending builtin output is flushed before any error so messages stay in order
 void throw_fatal_perror(char *errMsg){
+	bflush();
 	perror(errMsg);
-	exit(errno);
+	__fatal_exit(errno);
 }
 
 // Throw error if return code does match error code
@@ -40,6 +55,7 @@ int check_fatal_perror(char *errMsg, int retval, int error){
 
 int check_perror(char *errMsg, long long retval, long long error){
 	if(retval==error){
+		bflush();
 		perror(errMsg);
 		return 1;
 	}
@@ -49,12 +65,14 @@ int check_perror(char *errMsg, long long retval, long long error){
 // Handle custom errors
 void throw_fatal_error(int ERROR_CODE){
 	assert(ERROR_CODE >= 0 && ERROR_CODE < elist_sz);
+	bflush();
 	puts(c_errlist[ERROR_CODE]);
-	exit(ERROR_CODE);
+	__fatal_exit(ERROR_CODE);
 }
 
 void throw_error(int ERROR_CODE){
 	assert(ERROR_CODE >= 0 && ERROR_CODE < elist_sz);
+	bflush();
 	puts(c_errlist[ERROR_CODE]);
 }
 
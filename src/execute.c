@@ -7,9 +7,10 @@
  */
 int setup_redirection(Command *c){
 
-	// Special case, replay does not require this
-	if(!strcmp(c->name, "replay") || !strcmp(c->name, "repeat")) return 0;
-	if(!strcmp(c->name, "baywatch") && (c->infile || c->outfile)) return 2;
+	// Special case, replay does not require this. Neither do every and at, the command they schedule does.
+	if(!strcmp(c->name, "replay") || !strcmp(c->name, "repeat") || !strcmp(c->name, "every") || 
+	   !strcmp(c->name, "at")) return 0;
+	if(!strcmp(c->name, "baywatch") && (c->infile || c->outfile) && !baywatch_redirectable(c)) return 2;
 
 	// Required flags for i/o redirection
 	int r_flags = O_RDONLY;
@@ -48,10 +49,47 @@ void cleanup_redirection(){
 	}
 }
 
+/**
+ * @brief Points stdout (unless it's redirected) and stderr at KSH.detach_fd for a
+ * background command, if the shell has one
+ * @details The command server sets it so that & jobs don't hold on to the pipes
+ * the client's reply is read from. Their output is discarded, including what a
+ * builtin run with & prints itself.
+ * 
+ * @param saved Set to copies of stdout / stderr to restore with __reattach_output, not
+ * inherited by the command
+ */
+void __detach_output(Command *c, int saved[2]){
+	saved[0] = saved[1] = -1;
+	if(!c->runInBackground || KSH.detach_fd == -1) return;
+	bflush();
+	fflush(stdout);
+	if(!c->outfile){
+		saved[0] = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+		dup2(KSH.detach_fd, STDOUT_FILENO);
+	}
+	saved[1] = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+	dup2(KSH.detach_fd, STDERR_FILENO);
+}
+
+/**
+ * @brief Restores what __detach_output replaced
+ */
+void __reattach_output(int saved[2]){
+	if(saved[0] == -1 && saved[1] == -1) return;
+	bflush();
+	fflush(stdout);
+	for(int i=0; i<2; i++){
+		if(saved[i] == -1) continue;
+		check_fatal_perror("KSH", dup2(saved[i], STDOUT_FILENO + i), -1);
+		close(saved[i]);
+	}
+}
+
 /**
  * @brief Executes all commands in a pipe and sets up the fd pipes to one another
  * 
- * @return 0 on success, -1 on failure
+ * @return Status of the last command, -1 if setting up the pipes failed
  */
 int exec_pipe(Pipe *p){
 	
@@ -85,11 +123,70 @@ int exec_pipe(Pipe *p){
 	// If restoring stdin or stdout fails, throw fatal error and exit.
 	if(check_perror("Pipe", dup2(pfds[x^1][READ_END], STDIN_FILENO), -1)) status=-1;
 	check_fatal_perror("Pipe", dup2(ofd, STDOUT_FILENO), -1);
-	execute(p->c);
+	int last = execute(p->c);
 	if(check_perror("Pipe", close(pfds[x^1][READ_END]), -1)) status=-1;
 	check_fatal_perror("Pipe", dup2(ifd, STDIN_FILENO), -1);
+	close(ifd);
+	close(ofd);
 
-	return status;
+	return (status == -1) ? -1 : last;
+}
+
+/**
+ * @brief Forks and execs a system command in process group pgid
+ * @details The child gets default SIGINT / SIGTSTP handlers and SIGCHLD unblocked, 
+ * in case the caller blocked it to reap its children itself, and applies the
+ * command's launch attributes. Redirection must already be in place.
+ * 
+ * @param pgid Process group to join, 0 for a new group led by the child
+ * @return pid of the child, -1 on failure
+ */
+pid_t fork_command(Command *c, pid_t pgid){
+	// Don't let the child inherit pending output, builtin or stdio (an embedding program's)
+	bflush();
+	fflush(stdout);
+	pid_t pid = fork();
+	if(check_error(FORK_FAIL, pid, -1)) return -1;
+
+	if(ISCHILD(pid)){
+		// Give process it's own group id (or the given one) and restore default signal handlers
+		setpgid(0, pgid);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTSTP, SIG_DFL);
+		sigset_t mask;
+		sigemptyset(&mask);
+		sigaddset(&mask, SIGCHLD);
+		sigprocmask(SIG_UNBLOCK, &mask, NULL);
+		if(launch_apply(&c->launch) == -1) _exit(EXIT_FAILURE);
+
+		execvp(c->name, c->argv.arr);
+		// A background shell's fork has no history to save and the zygote / recorder
+		// aren't its own, throw_fatal_error leaves it with _exit
+		if(!KSH.background) cleanup();
+		throw_fatal_error(EXEC_FAIL);
+	}
+	// Set it from the parent too, so it's in place before either side relies on it
+	setpgid(pid, pgid ? pgid : pid);
+	return pid;
+}
+
+/**
+ * @brief Starts a system command in process group pgid, see fork_command
+ * @details Goes through the zygote when it runs, so the shell isn't copied. Forks
+ * the shell if it doesn't or can't take the request, and in subshells (timer runs,
+ * `replay &`, ksh_spawn), which must be the parent of what they wait for.
+ * 
+ * @return pid of the child, -1 on failure
+ */
+pid_t spawn_command(Command *c, pid_t pgid){
+	if(KSH.zygote.fd != -1){
+		// Output the shell still holds goes first
+		bflush();
+		fflush(stdout);
+		pid_t pid = zygote_spawn(&KSH.zygote, c->argv.arr, c->argc + 1, pgid, &c->launch);
+		if(pid > 0) return pid;
+	}
+	return fork_command(c, pgid);
 }
 
 /**
@@ -100,10 +197,18 @@ int exec_pipe(Pipe *p){
  * running.
  * 
  * @param c Command struct containing all details of command to execute
- * @return 0 if successful. -1 if failure.
+ * @return The exit status of a foreground system command (the signal number if it was
+ * killed or stopped), 0 once a background one is started, the builtin's return value
+ * otherwise. -1 on failure.
  */
 int execute(Command *c){
 	
+	// Launch attributes are applied by the child, builtins have none
+	if(c->launch.set && c->builtin != -1){
+		bprintf("%s: launch attributes only apply to system commands\n", c->name);
+		return -1;
+	}
+
 	int retvalue;
 	if((retvalue = setup_redirection(c))){
 		if(retvalue==2)
@@ -112,54 +217,51 @@ int execute(Command *c){
 	}
 
 	int status = -1;
+	int saved[2];
+	__detach_output(c, saved);
+
 	// Check if system command
-	if(!is_builtin(c->name)){
-		pid_t pid = fork();
+	if(c->builtin == -1){
+		pid_t pid = spawn_command(c, 0);
+		__reattach_output(saved);
+		if(pid == -1){
+			cleanup_redirection();
+			return -1;
+		}
 
-		if(check_error(FORK_FAIL, pid, -1)) return -1;
+		// Add background process to list of all open processes. insert_process puts it at
+		// the head, its launch attributes are kept for jobs -v.
+		insert_process(pid, c->name, &(KSH.plist.head));
+		KSH.plist.head->launch = c->launch;
 
-		// Create process group for child and execute program
-		if(ISCHILD(pid)){
-			// Give process it's own group id and restore default signal handlers
-			setpgid(0, 0);
-			signal(SIGINT, SIG_DFL);
-        	signal(SIGTSTP, SIG_DFL);
+		// Run process
+		// If foreground process
+		if(!c->runInBackground){
+			int wstatus;
+			
+			// Move process to foreground
+			make_fg_process(pid);
+			// Wait for termination
+			waitpid(pid, &wstatus, WUNTRACED);
 
-			execvp(c->name, c->argv.arr);
-			cleanup();
-			throw_fatal_error(EXEC_FAIL);
+			// If it was suspended, don't remove from proc list
+			if(WIFSTOPPED(wstatus)) status = WSTOPSIG(wstatus);
+			// If it was terminated, remove from proc list and return appropriate status
+			else if(WIFEXITED(wstatus) || WIFSIGNALED(wstatus)){
+				remove_process(pid, &(KSH.plist.head));
+				status = (WIFEXITED(wstatus)) ? WEXITSTATUS(wstatus) : WTERMSIG(wstatus);
+			}
+			// Make parent the foreground process again
+			make_fg_parent();
 		}
 		else{
-			// Add background process to list of all open processes
-			insert_process(pid, c->name, &(KSH.plist.head));
-
-        	// Run process
-			// If foreground process
-			if(!c->runInBackground){
-				int status;
-				
-				// Move process to foreground
-				make_fg_process(pid);
-				// Wait for termination
-				waitpid(pid, &status, WUNTRACED);
-
-				// If it was suspended, don't remove from proc list
-				if(WIFSTOPPED(status)) status = WSTOPSIG(status);
-				// If it was terminated, remove from proc list and return appropriate status
-				else if(WIFEXITED(status) || WIFSIGNALED(status)){
-					remove_process(pid, &(KSH.plist.head));
-					status = (WIFEXITED(status)) ? WEXITSTATUS(status) : WTERMSIG(status);
-				}
-				// Make parent the foreground process again
-				make_fg_parent();
-			}
-			else{
-				if(c->runInBackground) printf("%d\n", pid);
-			}
+			if(c->runInBackground) printf("%d\n", pid);
+			status = 0;
 		}
 	}
 	else{
 		status = exec_builtin(c);
+		__reattach_output(saved);
 	}
 	cleanup_redirection();
 	return status;
@@ -0,0 +1,66 @@
+/**
+ * Build time generator of the builtin dispatch table. Finds a seed for which
+ * builtin_hash sends every name in builtins.def to a slot of its own in a power
+ * of two sized table, then prints the table as a header for builtins.c. The
+ * smallest table that fits all builtins is tried first.
+ */
+
+#include<stdio.h>
+#include<stdint.h>
+#include<string.h>
+#include "builtin_hash.h"
+
+#define MAX_SEEDS (1u << 20)
+
+#define BUILTIN(name) #name,
+const char *names[] = {
+#include "builtins.def"
+};
+#undef BUILTIN
+
+#define NBUILTINS (sizeof(names) / sizeof(names[0]))
+
+/**
+ * @brief Fills slots for a seed
+ * @return 0 if every name got a slot of its own, -1 on a collision
+ */
+int try_seed(uint32_t seed, int *slots, uint32_t size){
+	for(uint32_t i=0; i<size; i++) slots[i] = -1;
+	for(uint32_t id=0; id<NBUILTINS; id++){
+		uint32_t slot = builtin_hash(names[id], seed) & (size - 1);
+		if(slots[slot] != -1) return -1;
+		slots[slot] = id;
+	}
+	return 0;
+}
+
+int main(){
+	for(uint32_t i=0; i<NBUILTINS; i++)
+		for(uint32_t j=0; j<i; j++)
+			if(!strcmp(names[i], names[j])){
+				fprintf(stderr, "gen_builtins: builtin %s is listed twice\n", names[i]);
+				return 1;
+			}
+
+	uint32_t size = 1;
+	while(size < NBUILTINS) size <<= 1;
+	for(; size <= (1u << 16); size <<= 1){
+		int slots[1u << 16];
+		for(uint32_t seed=0; seed<MAX_SEEDS; seed++){
+			if(try_seed(seed, slots, size) == -1) continue;
+
+			printf("// Generated by gen_builtins from builtins.def. Do not edit.\n\n");
+			printf("#define BUILTIN_COUNT %zu\n", NBUILTINS);
+			printf("#define BUILTIN_HASH_SEED %uu\n", seed);
+			printf("#define BUILTIN_TABLE_SIZE %u\n\n", size);
+			printf("// Builtin id (jumptable index) per hash slot, -1 for empty slots\n");
+			printf("const int builtin_slots[BUILTIN_TABLE_SIZE] = {");
+			for(uint32_t i=0; i<size; i++)
+				printf("%s%d", (i % 16) ? ", " : (i ? ",\n\t" : "\n\t"), slots[i]);
+			printf("\n};\n");
+			return 0;
+		}
+	}
+	fprintf(stderr, "gen_builtins: no perfect hash found\n");
+	return 1;
+}
@@ -0,0 +1,155 @@
+/**
+ * This is the code for a small uid/gid -> name cache. Looking up a name with
+ * getpwuid / getgrgid can hit nscd or the network, so every id is looked up 
+ * at most once per shell session (or until the cache is flushed).
+ */
+
+#include "libs.h"
+#include "idcache.h"
+
+/**
+ * @brief Multiplicative hash of an id. Table size must be a power of 2.
+ */
+uint32_t __id_hash(uint32_t id, uint32_t table_size){
+	return (id * 2654435761u) & (table_size - 1);
+}
+
+/**
+ * @brief Returns the slot holding id, or the empty slot it should be inserted in
+ */
+id_entry* __idcache_slot(id_cache *c, uint32_t id){
+	uint32_t i = __id_hash(id, c->table_size);
+	while(c->table[i].used && c->table[i].id != id)
+		i = (i + 1) & (c->table_size - 1);
+	return &c->table[i];
+}
+
+/**
+ * @brief Doubles the table size and rehashes all entries
+ */
+void __idcache_grow(id_cache *c){
+	id_entry *old = c->table;
+	uint32_t old_size = c->table_size;
+	c->table_size <<= 1;
+	c->table = check_bad_alloc(calloc(c->table_size, sizeof(id_entry)));
+	for(uint32_t i=0; i<old_size; i++)
+		if(old[i].used) *__idcache_slot(c, old[i].id) = old[i];
+	free(old);
+}
+
+/**
+ * @brief Creates an empty cache
+ * @param n Initial table size. Must be a power of 2.
+ */
+void create_idcache(id_cache *c, uint32_t n){
+	c->table = check_bad_alloc(calloc(n, sizeof(id_entry)));
+	c->table_size = n;
+	c->size = 0;
+	c->hits = c->misses = 0;
+	pthread_mutex_init(&c->lock, NULL);
+}
+
+/**
+ * @brief Frees all cached names and the table
+ */
+void destroy_idcache(id_cache *c){
+	for(uint32_t i=0; i<c->table_size; i++)
+		if(c->table[i].used) free(c->table[i].name);
+	free(c->table);
+	c->table = NULL;
+	c->size = c->table_size = 0;
+	pthread_mutex_destroy(&c->lock);
+}
+
+/**
+ * @brief Looks up id in the cache, calling lookup on a miss
+ * @details Ids that do not resolve are cached as well (negative entries)
+ * so they are not looked up again. Safe to call from multiple threads.
+ * 
+ * @return Cached name. NULL if the id has no name.
+ */
+string __idcache_get(id_cache *c, uint32_t id, string (*lookup)(uint32_t)){
+	pthread_mutex_lock(&c->lock);
+	id_entry *e = __idcache_slot(c, id);
+	if(e->used){
+		c->hits++;
+		pthread_mutex_unlock(&c->lock);
+		return e->name;
+	}
+
+	// Keep the load factor under 3/4
+	c->misses++;
+	if((c->size + 1) * 4 > c->table_size * 3){
+		__idcache_grow(c);
+		e = __idcache_slot(c, id);
+	}
+	string name = lookup(id);
+	e->id = id;
+	e->used = true;
+	e->name = (name) ? check_bad_alloc(strdup(name)) : NULL;
+	c->size++;
+	pthread_mutex_unlock(&c->lock);
+	return e->name;
+}
+
+/**
+ * @brief getpwuid wrapper returning only the name
+ */
+string __lookup_user(uint32_t uid){
+	struct passwd *pw = getpwuid(uid);
+	return (pw) ? pw->pw_name : NULL;
+}
+
+/**
+ * @brief getgrgid wrapper returning only the name
+ */
+string __lookup_group(uint32_t gid){
+	struct group *gr = getgrgid(gid);
+	return (gr) ? gr->gr_name : NULL;
+}
+
+/**
+ * @brief Returns the user name of uid. NULL if it has none. Must not be freed.
+ */
+string uid_to_name(uid_t uid){
+	return __idcache_get(&KSH.users, uid, __lookup_user);
+}
+
+/**
+ * @brief Returns the group name of gid. NULL if it has none. Must not be freed.
+ */
+string gid_to_name(gid_t gid){
+	return __idcache_get(&KSH.groups, gid, __lookup_group);
+}
+
+/**
+ * @brief Shows uid/gid cache statistics or flushes the cache
+ * @details Usage: `idcache` prints entries, hits and misses of both caches. 
+ * `idcache -r` drops all cached names so they are looked up again.
+ * 
+ * @return 0 on success. -1 on failure.
+ */
+int idcache(Command *c){
+	if(c->argc > 1){
+		throw_error(TOO_MANY_ARGS);
+		return -1;
+	}
+
+	if(c->argc == 1){
+		if(strcmp(c->argv.arr[1], "-r")){
+			throw_error(BAD_FLAGS);
+			return -1;
+		}
+		uint32_t n = KSH.users.table_size;
+		destroy_idcache(&KSH.users);
+		create_idcache(&KSH.users, n);
+		n = KSH.groups.table_size;
+		destroy_idcache(&KSH.groups);
+		create_idcache(&KSH.groups, n);
+		return 0;
+	}
+
+	bprintf("users: %u entries, %lu hits, %lu misses\n", KSH.users.size, KSH.users.hits, KSH.users.misses);
+	bprintf("groups: %u entries, %lu hits, %lu misses\n", KSH.groups.size, KSH.groups.hits, KSH.groups.misses);
+	return 0;
+}
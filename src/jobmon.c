@@ -0,0 +1,182 @@
+#include "libs.h"
+#include "jobmon.h"
+
+// -------------------------------- Util functions --------------------------------
+
+/**
+ * @brief Opens /proc/pid/<file> if fd isn't open yet. Kept open for later samples.
+ * @return The fd, -1 on failure
+ */
+int jobmon_open(int *fd, pid_t pid, const char *file){
+	if(*fd == -1) *fd = procfs_open(pid, file);
+	return *fd;
+}
+
+/**
+ * @brief Closes the /proc fds cached for a process. Called when it leaves the job table.
+ */
+void jobmon_close(Process *p){
+	if(p->stat_fd != -1) close(p->stat_fd);
+	if(p->io_fd != -1) close(p->io_fd);
+	p->stat_fd = p->io_fd = -1;
+}
+
+/**
+ * @brief Samples a single job from its stat and io files
+ * @details /proc/pid/io is only readable for our own processes, its counters are
+ * left at -1 otherwise.
+ * 
+ * @return 0 on success, -1 if the process is gone
+ */
+int __jobmon_sample_one(Process *p, job_stats *s, int64_t now_ns){
+	static int64_t hz = 0;
+	if(!hz) hz = sysconf(_SC_CLK_TCK);
+
+	proc_stat st;
+	if(jobmon_open(&p->stat_fd, p->id, "stat") == -1 || 
+	   procfs_read_stat(p->stat_fd, &st, PS_STATE | PS_TIMES | PS_THREADS | PS_START | PS_RSS) == -1)
+		return -1;
+
+	int64_t ticks = st.utime + st.stime;
+	s->state = st.state;
+	s->threads = st.num_threads;
+	s->rss_kb = st.rss * (sysconf(_SC_PAGESIZE) >> 10);
+	if(p->sampled_ns && now_ns > p->sampled_ns)
+		s->cpu = (ticks - p->cpu_ticks) * 1000 * 1000000000LL / ((now_ns - p->sampled_ns) * hz);
+	else{
+		int64_t alive = now_ns / (1000000000LL / hz) - (int64_t) st.starttime;
+		s->cpu = (alive > 0) ? ticks * 1000 / alive : 0;
+	}
+	p->cpu_ticks = ticks;
+	p->sampled_ns = now_ns;
+
+	proc_io io;
+	s->read_bytes = s->write_bytes = -1;
+	if(jobmon_open(&p->io_fd, p->id, "io") != -1 && procfs_read_io(p->io_fd, &io, PIO_READ_BYTES | PIO_WRITE_BYTES) != -1){
+		s->read_bytes = io.read_bytes;
+		s->write_bytes = io.write_bytes;
+	}
+	return 0;
+}
+
+/**
+ * @brief Samples every tracked job in a single pass over the job table
+ * @details SIGCHLD is blocked during the pass so the handler can't remove the
+ * process being sampled. /proc fds are opened on the first sample of a job and
+ * reused for later ones.
+ * 
+ * @param stats Set to a freshly alloc'd array of samples, free with jobmon_free
+ * @return Number of jobs sampled
+ */
+uint32_t jobmon_sample(job_stats **stats){
+	sigset_t mask, old;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, &old);
+
+	struct timespec ts;
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	int64_t now_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+	uint32_t n = 0, size = KSH.plist.size(&KSH.plist);
+	job_stats *s = check_bad_alloc(calloc(max(size, 1), sizeof(job_stats)));
+	for(Process *p = KSH.plist.head; p; p = p->next){
+		if(__jobmon_sample_one(p, &s[n], now_ns) == -1) continue;
+		s[n].job_num = p->job_num;
+		s[n].pid = p->id;
+		s[n].launch = p->launch;
+		s[n++].name = check_bad_alloc(strdup(p->str));
+	}
+
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	*stats = s;
+	return n;
+}
+
+void jobmon_free(job_stats *stats, uint32_t n){
+	for(uint32_t i=0; i<n; i++)
+		free(stats[i].name);
+	free(stats);
+}
+
+/**
+ * @brief Prints samples as a table, one line per job
+ */
+void jobmon_print(out_buffer *out, job_stats *stats, uint32_t n){
+	buf_printf(out, "%-6s %7s %s %6s %9s %10s %10s %4s  %s\n", "JOB", "PID", "S", "CPU%", "RSS(kB)", 
+			   "READ(kB)", "WRITE(kB)", "THR", "COMMAND");
+	for(uint32_t i=0; i<n; i++){
+		job_stats *s = &stats[i];
+		char job[24];
+		sprintf(job, "[%lu]", s->job_num);
+		buf_printf(out, "%-6s %7d %c %4ld.%ld %9ld ", job, s->pid, s->state, s->cpu / 10, s->cpu % 10, s->rss_kb);
+		if(s->read_bytes == -1) buf_printf(out, "%10s %10s ", "-", "-");
+		else buf_printf(out, "%10ld %10ld ", s->read_bytes >> 10, s->write_bytes >> 10);
+		buf_printf(out, "%4ld  ", s->threads);
+		launch_print(out, &s->launch);
+		buf_printf(out, "%s\n", s->name);
+	}
+}
+
+/**
+ * @brief Live view of the resource usage of all tracked jobs, busiest first
+ * @details Usage: `jobtop [-n secs]`. Refreshes every second by default, intervals
+ * can be fractional. Press `q` to quit.
+ * 
+ * @return 0 on success, -1 on failure
+ */
+int jobtop(Command *c){
+	struct timespec interval = {1, 0};
+	if(c->argc == 2 && !strcmp(c->argv.arr[1], "-n")){
+		if(string_to_interval(c->argv.arr[2], &interval) == -1){
+			throw_error(BAD_ARGS); return -1;
+		}
+	}
+	else if(c->argc){
+		throw_error(BAD_ARGS); return -1;
+	}
+
+	int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if(check_perror("jobtop", tfd, -1)) return -1;
+	struct itimerspec its = {.it_interval = interval, .it_value = {0, 1}};
+	timerfd_settime(tfd, 0, &its, NULL);
+
+	// Enable raw mode so we can setup a listener for the `q` key
+	enableRawMode();
+	struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {tfd, POLLIN, 0}};
+	while(poll(fds, 2, -1) != -1 || errno == EINTR){
+		char ch;
+		if((fds[0].revents & POLLIN) && read(STDIN_FILENO, &ch, 1) == 1 && ch == 'q') break;
+		if(fds[0].revents & (POLLHUP | POLLERR)) break;
+
+		uint64_t ticks;
+		if(!(fds[1].revents & POLLIN) || read(tfd, &ticks, sizeof(ticks)) != sizeof(ticks)) continue;
+
+		job_stats *stats;
+		uint32_t n = jobmon_sample(&stats);
+		int64_t *keys = check_bad_alloc(malloc(max(n, 1) * sizeof(int64_t)));
+		string *names = check_bad_alloc(malloc(max(n, 1) * sizeof(string)));
+		for(uint32_t i=0; i<n; i++){
+			keys[i] = stats[i].cpu;
+			names[i] = stats[i].name;
+		}
+		uint32_t *perm = sort_by_key(names, keys, n);
+		apply_permutation(stats, sizeof(job_stats), perm, n);
+
+		// Redraw from the top left corner
+		bprintf("\033[H\033[2Jjobtop - %u jobs, every %ld.%03lds (q to quit)\n\n", n, interval.tv_sec, 
+				interval.tv_nsec / 1000000);
+		jobmon_print(&KSH.out, stats, n);
+		bflush();
+
+		free(perm);
+		free(names);
+		free(keys);
+		jobmon_free(stats, n);
+	}
+
+	// Set terminal back to normal
+	disableRawMode();
+	close(tfd);
+	return 0;
+}
@@ -0,0 +1,189 @@
+/**
+ * This is the code for launch attributes: `@key=value` tokens in front of a
+ * command name that the child applies to itself between fork and exec, without
+ * wrapping the command in taskset / nice / ionice / chrt.
+ *   @cpu=0-3,6		CPU affinity
+ *   @nice=10		nice value, -20 to 19
+ *   @io=idle|be:N|rt:N	I/O scheduling class and level (0-7)
+ *   @sched=other|batch|idle|fifo:N|rr:N	scheduling policy and realtime priority (1-99)
+ * The struct is flat so it can be copied into a zygote request as is.
+ */
+
+#include "libs.h"
+#include "launch.h"
+
+const launch_class launch_io_classes[] = {
+	{"idle", LAUNCH_IOPRIO_CLASS_IDLE, 0, 0, 0},
+	{"be", LAUNCH_IOPRIO_CLASS_BE, 0, 7, 4},
+	{"rt", LAUNCH_IOPRIO_CLASS_RT, 0, 7, 4},
+	{NULL, 0, 0, 0, 0}
+};
+
+const launch_class launch_sched_classes[] = {
+	{"other", SCHED_OTHER, 0, 0, 0},
+	{"batch", SCHED_BATCH, 0, 0, 0},
+	{"idle", SCHED_IDLE, 0, 0, 0},
+	{"fifo", SCHED_FIFO, 1, 99, 1},
+	{"rr", SCHED_RR, 1, 99, 1},
+	{NULL, 0, 0, 0, 0}
+};
+
+// -------------------------------- Parsing --------------------------------
+
+void launch_init(launch_attr *a){
+	memset(a, 0, sizeof(launch_attr));
+}
+
+/**
+ * @brief Parses a whole decimal number in [lo, hi]
+ * @return 0 on success, -1 if str is not one
+ */
+int __launch_number(string str, int64_t lo, int64_t hi, int32_t *num){
+	char *end;
+	errno = 0;
+	int64_t n = strtoll(str, &end, 10);
+	if(!*str || *end || errno || n < lo || n > hi) return -1;
+	*num = n;
+	return 0;
+}
+
+/**
+ * @brief Parses a CPU list such as 0-3,6,8-9 into the affinity mask
+ * @return 0 on success, -1 if the list is malformed or a CPU is out of range
+ */
+int __launch_parse_cpus(launch_attr *a, string str){
+	memset(a->cpus, 0, sizeof(a->cpus));
+	for(char *ptr = str, *end;; ptr = end + 1){
+		if(!isdigit(*ptr)) return -1;
+		int64_t lo = strtoll(ptr, &end, 10), hi = lo;
+		if(*end == '-'){
+			if(!isdigit(end[1])) return -1;
+			hi = strtoll(end + 1, &end, 10);
+		}
+		if(lo > hi || hi >= LAUNCH_MAX_CPUS) return -1;
+		for(int64_t cpu = lo; cpu <= hi; cpu++)
+			a->cpus[cpu / 64] |= 1ULL << (cpu % 64);
+		if(!*end) return 0;
+		if(*end != ',') return -1;
+	}
+}
+
+/**
+ * @brief Parses name[:level] against a table of classes
+ * @details A class that takes a level gets its default one if none is given.
+ * @return 0 on success, -1 if the class is unknown or the level is out of range
+ */
+int __launch_parse_class(const launch_class *classes, string str, int32_t *id, int32_t *level){
+	char *colon = strchr(str, ':');
+	size_t len = colon ? (size_t)(colon - str) : strlen(str);
+	for(const launch_class *cl = classes; cl->name; cl++){
+		if(strlen(cl->name) != len || strncmp(cl->name, str, len)) continue;
+		*id = cl->id;
+		*level = cl->def;
+		if(!colon) return 0;
+		if(cl->lo == cl->hi) return -1;
+		return __launch_number(colon + 1, cl->lo, cl->hi, level);
+	}
+	return -1;
+}
+
+/**
+ * @brief Adds one @key=value token to the attributes. A later token for the same key wins.
+ * @return 0 on success, -1 if it's not a valid attribute
+ */
+int launch_parse(launch_attr *a, string token){
+	char *value = strchr(token, '=');
+	if(token[0] != '@' || !value) return -1;
+	string key = token + 1;
+	size_t len = value++ - key;
+
+	if(len == 3 && !strncmp(key, "cpu", len)){
+		if(__launch_parse_cpus(a, value) == -1) return -1;
+		a->set |= LAUNCH_CPU;
+	}
+	else if(len == 4 && !strncmp(key, "nice", len)){
+		if(__launch_number(value, -20, 19, &a->nice) == -1) return -1;
+		a->set |= LAUNCH_NICE;
+	}
+	else if(len == 2 && !strncmp(key, "io", len)){
+		if(__launch_parse_class(launch_io_classes, value, &a->io_class, &a->io_level) == -1) return -1;
+		a->set |= LAUNCH_IO;
+	}
+	else if(len == 5 && !strncmp(key, "sched", len)){
+		if(__launch_parse_class(launch_sched_classes, value, &a->policy, &a->priority) == -1) return -1;
+		a->set |= LAUNCH_SCHED;
+	}
+	else return -1;
+	return 0;
+}
+
+// -------------------------------- Applying --------------------------------
+
+/**
+ * @brief Applies the attributes to the calling process. Meant for the child, before exec.
+ * @details The scheduling policy is set before the nice value, so the latter sticks
+ * for batch and idle. Failures (e.g. realtime policies or negative nice values without
+ * the privilege for them) are reported on stderr.
+ *
+ * @return 0 on success, -1 on the first attribute that can't be applied
+ */
+int launch_apply(const launch_attr *a){
+	if(a->set & LAUNCH_CPU){
+		if(check_perror("launch: @cpu", syscall(SYS_sched_setaffinity, 0, sizeof(a->cpus), a->cpus), -1)) return -1;
+	}
+	if(a->set & LAUNCH_SCHED){
+		struct sched_param sp = {.sched_priority = a->priority};
+		if(check_perror("launch: @sched", sched_setscheduler(0, a->policy, &sp), -1)) return -1;
+	}
+	if(a->set & LAUNCH_NICE){
+		if(check_perror("launch: @nice", setpriority(PRIO_PROCESS, 0, a->nice), -1)) return -1;
+	}
+	if(a->set & LAUNCH_IO){
+		int ioprio = (a->io_class << LAUNCH_IOPRIO_CLASS_SHIFT) | a->io_level;
+		if(check_perror("launch: @io", syscall(SYS_ioprio_set, LAUNCH_IOPRIO_WHO_PROCESS, 0, ioprio), -1)) return -1;
+	}
+	return 0;
+}
+
+// -------------------------------- Printing --------------------------------
+
+/**
+ * @brief Prints name[:level] of the class id in the table
+ */
+void __launch_print_class(out_buffer *out, const launch_class *classes, int32_t id, int32_t level){
+	for(const launch_class *cl = classes; cl->name; cl++){
+		if(cl->id != id) continue;
+		if(cl->lo == cl->hi) buf_printf(out, "%s ", cl->name);
+		else buf_printf(out, "%s:%d ", cl->name, level);
+		return;
+	}
+}
+
+/**
+ * @brief Prints the attributes that are set as they would be typed, each followed by a space
+ */
+void launch_print(out_buffer *out, const launch_attr *a){
+	if(a->set & LAUNCH_CPU){
+		buf_printf(out, "@cpu=");
+		const char *sep = "";
+		for(int cpu = 0; cpu < LAUNCH_MAX_CPUS; cpu++){
+			if(!(a->cpus[cpu / 64] & (1ULL << (cpu % 64)))) continue;
+			int last = cpu;
+			while(last + 1 < LAUNCH_MAX_CPUS && (a->cpus[(last + 1) / 64] & (1ULL << ((last + 1) % 64)))) last++;
+			if(last == cpu) buf_printf(out, "%s%d", sep, cpu);
+			else buf_printf(out, "%s%d-%d", sep, cpu, last);
+			sep = ",";
+			cpu = last;
+		}
+		buf_printf(out, " ");
+	}
+	if(a->set & LAUNCH_NICE) buf_printf(out, "@nice=%d ", a->nice);
+	if(a->set & LAUNCH_IO){
+		buf_printf(out, "@io=");
+		__launch_print_class(out, launch_io_classes, a->io_class, a->io_level);
+	}
+	if(a->set & LAUNCH_SCHED){
+		buf_printf(out, "@sched=");
+		__launch_print_class(out, launch_sched_classes, a->policy, a->priority);
+	}
+}
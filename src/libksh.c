@@ -0,0 +1,310 @@
+/**
+ * This is the code behind the embedding API (see libksh.h). Every call makes
+ * the given shell the calling thread's current one for its duration, so the
+ * parser and executor run on its state exactly as they do on the interactive
+ * shell's. Embedded shells install no signal handlers in the host, their
+ * background jobs are reaped on the next call instead. Calls that touch the
+ * process's fds hold ksh_lock (see libksh.h).
+ */
+
+#include "libs.h"
+
+extern char **environ;
+
+// Serializes the calls that run lines, they rewrite the process's stdin / stdout / stderr
+pthread_mutex_t ksh_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct ksh_job{
+	pid_t pid;
+	int fd;
+	char *out;
+	size_t len, cap;
+	int status;
+	bool done;
+};
+
+// -------------------------------- Shells --------------------------------
+
+/**
+ * @brief Creates a shell, with the current working directory as its home
+ */
+ksh_shell* ksh_create(){
+	Shell *sh = check_bad_alloc(calloc(1, sizeof(Shell)));
+	pthread_mutex_lock(&ksh_lock);
+	Shell *prev = ksh_ctx;
+	ksh_ctx = sh;
+	init_state();
+	KSH.background = true;
+	ksh_ctx = prev;
+	pthread_mutex_unlock(&ksh_lock);
+	return sh;
+}
+
+/**
+ * @brief Frees a shell and everything it holds. Its background jobs keep running.
+ */
+void ksh_destroy(ksh_shell *sh){
+	pthread_mutex_lock(&ksh_lock);
+	Shell *prev = ksh_ctx;
+	ksh_ctx = sh;
+	cleanup_state();
+	ksh_ctx = prev;
+	pthread_mutex_unlock(&ksh_lock);
+	free(sh);
+}
+
+/**
+ * @brief Removes the current shell's background jobs that have finished from its job table
+ */
+void __ksh_reap(){
+	int status;
+	for(Process *p = KSH.plist.head, *next; p; p = next){
+		next = p->next;
+		pid_t pid = waitpid(p->id, &status, WNOHANG);
+		if(pid == -1 || (pid == p->id && !WIFSTOPPED(status))) remove_process(p->id, &(KSH.plist.head));
+	}
+}
+
+/**
+ * @brief Runs a command line to completion, as if it was typed at the prompt
+ * @details Anything the prompt takes works: ; and & separated commands, pipes,
+ * redirection, builtins and plugins. Builtin output is flushed before returning.
+ * Other threads' calls wait until it is done.
+ *
+ * @return The status of the last command, -1 if it could not be run
+ */
+int ksh_run(ksh_shell *sh, const char *line){
+	pthread_mutex_lock(&ksh_lock);
+	Shell *prev = ksh_ctx;
+	ksh_ctx = sh;
+	__ksh_reap();
+
+	string buf = check_bad_alloc(strdup(line));
+	KSH.status = 0;
+	parse(buf);
+	bflush();
+	free(buf);
+
+	int status = KSH.status;
+	ksh_ctx = prev;
+	pthread_mutex_unlock(&ksh_lock);
+	return status;
+}
+
+/**
+ * @brief Returns the status of the last command the shell ran
+ */
+int ksh_last_status(ksh_shell *sh){
+	return sh->status;
+}
+
+// -------------------------------- Jobs --------------------------------
+
+/**
+ * @brief Starts a line that is a single system command with posix_spawn
+ * @details No copy of the caller is made (posix_spawn uses vfork semantics), so a
+ * launch costs the same however much memory the caller has. Redirection and the
+ * capture pipe are set up as file actions.
+ *
+ * @param out_fd Write end of the capture pipe, -1 if nothing is captured
+ * @return pid of the command, 0 if the line needs the executor or spawning failed
+ */
+pid_t __ksh_spawn_simple(const char *line, int out_fd, int flags){
+	// Launch attributes (@key=value) are applied by the executor's child
+	if(strpbrk(line, ";&|@")) return 0;
+	string buf = check_bad_alloc(strdup(line));
+	char *saveptr;
+	char *name = strtok_r(buf, " \t", &saveptr);
+	if(!name){
+		free(buf); return 0;
+	}
+
+	Command c;
+	init_command(&c, name);
+	char *args = strtok_r(NULL, "", &saveptr);
+	if(args) parse_args(&c, args);
+	pid_t pid = 0;
+	if(c.valid && c.builtin == -1){
+		posix_spawn_file_actions_t fa;
+		posix_spawnattr_t attr;
+		posix_spawn_file_actions_init(&fa);
+		posix_spawnattr_init(&attr);
+
+		if(flags & KSH_CAPTURE_STDOUT) posix_spawn_file_actions_adddup2(&fa, out_fd, STDOUT_FILENO);
+		if(flags & KSH_CAPTURE_STDERR) posix_spawn_file_actions_adddup2(&fa, out_fd, STDERR_FILENO);
+		if(c.infile) posix_spawn_file_actions_addopen(&fa, STDIN_FILENO, c.infile, O_RDONLY, 0644);
+		if(c.outfile) posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, c.outfile,
+			O_WRONLY | O_CREAT | ((c.append)?O_APPEND:O_TRUNC), 0644);
+
+		// Own process group, default handlers and nothing blocked, as spawn_command sets up
+		sigset_t all, none;
+		sigfillset(&all);
+		sigemptyset(&none);
+		posix_spawnattr_setpgroup(&attr, 0);
+		posix_spawnattr_setsigdefault(&attr, &all);
+		posix_spawnattr_setsigmask(&attr, &none);
+		posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+
+		if(posix_spawnp(&pid, c.name, &fa, &attr, c.argv.arr, environ)) pid = 0;
+		posix_spawn_file_actions_destroy(&fa);
+		posix_spawnattr_destroy(&attr);
+	}
+	destroy_command(&c);
+	free(buf);
+	return pid;
+}
+
+/**
+ * @brief Starts a command line in a child process and returns without waiting for it
+ * @details A single system command is started directly with posix_spawn. Anything
+ * else (several commands, pipes, builtins) runs through the executor in a fork of
+ * the caller, not in a shell that has to start up. The job leads its own process group.
+ *
+ * @param flags KSH_CAPTURE_STDOUT collects the job's stdout, KSH_CAPTURE_STDERR its
+ * stderr (into the same buffer). Otherwise they are the caller's.
+ * @return The job, NULL on failure. Must be freed with ksh_job_free.
+ */
+ksh_job* ksh_spawn(ksh_shell *sh, const char *line, int flags){
+	int pfd[2] = {-1, -1};
+	if(flags){
+		if(check_perror("ksh_spawn", pipe(pfd), -1)) return NULL;
+		fcntl(pfd[READ_END], F_SETFD, FD_CLOEXEC);
+		fcntl(pfd[WRITE_END], F_SETFD, FD_CLOEXEC);
+	}
+
+	pthread_mutex_lock(&ksh_lock);
+	Shell *prev = ksh_ctx;
+	ksh_ctx = sh;
+	__ksh_reap();
+	pid_t pid = __ksh_spawn_simple(line, pfd[WRITE_END], flags);
+
+	if(!pid){
+		bflush();
+		fflush(stdout);
+		pid = fork();
+		if(ISCHILD(pid)){
+			setpgid(0, 0);
+			if(flags & KSH_CAPTURE_STDOUT) dup2(pfd[WRITE_END], STDOUT_FILENO);
+			if(flags & KSH_CAPTURE_STDERR) dup2(pfd[WRITE_END], STDERR_FILENO);
+			parse(check_bad_alloc(strdup(line)));
+			bflush();
+			_exit(KSH.status & 0xff);
+		}
+		if(pid != -1) setpgid(pid, pid);
+	}
+	ksh_ctx = prev;
+	pthread_mutex_unlock(&ksh_lock);
+	if(pfd[WRITE_END] != -1) close(pfd[WRITE_END]);
+	if(check_error(FORK_FAIL, pid, -1)){
+		if(pfd[READ_END] != -1) close(pfd[READ_END]);
+		return NULL;
+	}
+
+	ksh_job *job = check_bad_alloc(calloc(1, sizeof(ksh_job)));
+	job->pid = pid;
+	job->fd = pfd[READ_END];
+	job->status = -1;
+	if(job->fd != -1) fcntl(job->fd, F_SETFL, O_NONBLOCK);
+	return job;
+}
+
+/**
+ * @brief Reads whatever the job has written so far into its buffer
+ * @return 1 if more may come, 0 once its end of the pipe is closed
+ */
+int __ksh_drain(ksh_job *job){
+	while(job->fd != -1){
+		if(job->cap - job->len < 4096){
+			job->cap = job->cap ? job->cap * 2 : 8192;
+			job->out = check_bad_alloc(realloc(job->out, job->cap));
+		}
+		// One byte is kept for the terminating NUL
+		ssize_t n = read(job->fd, job->out + job->len, job->cap - job->len - 1);
+		if(n > 0){
+			job->len += n; continue;
+		}
+		if(n == -1 && errno == EINTR) continue;
+		if(n == -1 && errno == EAGAIN) return 1;
+		close(job->fd);
+		job->fd = -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Reaps the job if it has exited
+ * @details Status is the exit code, or 128 + the signal that killed it. -1 if the
+ * child could not be waited for (e.g. the host ignores SIGCHLD).
+ *
+ * @param options 0 to block until it exits, WNOHANG not to
+ * @return 1 if it is done, 0 otherwise
+ */
+int __ksh_collect(ksh_job *job, int options){
+	int wstatus;
+	pid_t pid;
+	while((pid = waitpid(job->pid, &wstatus, options)) == -1 && errno == EINTR);
+	if(pid == 0) return 0;
+	if(pid == job->pid)
+		job->status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+	job->done = true;
+	return 1;
+}
+
+pid_t ksh_job_pid(ksh_job *job){
+	return job->pid;
+}
+
+/**
+ * @brief Returns the fd the job's output is read from, for the caller's event loop
+ * @return The fd, -1 if nothing is captured or all of it has been read. Call
+ * ksh_poll when it is readable.
+ */
+int ksh_job_fd(ksh_job *job){
+	return job->fd;
+}
+
+/**
+ * @brief Collects the job's output so far without blocking, reaps it once it is done
+ * @return 1 if it is done (see ksh_wait for the status), 0 if it is still running
+ */
+int ksh_poll(ksh_job *job){
+	if(job->done) return 1;
+	if(__ksh_drain(job)) return 0;
+	return __ksh_collect(job, WNOHANG);
+}
+
+/**
+ * @brief Collects the job's output and blocks until it exits
+ * @return Its exit code, 128 + the signal that killed it, -1 if it could not be waited for
+ */
+int ksh_wait(ksh_job *job){
+	struct pollfd pfd = {job->fd, POLLIN, 0};
+	while(!job->done && __ksh_drain(job)){
+		pfd.fd = job->fd;
+		if(poll(&pfd, 1, -1) == -1 && errno != EINTR) break;
+	}
+	if(!job->done) __ksh_collect(job, 0);
+	return job->status;
+}
+
+/**
+ * @brief Returns the captured output, NUL terminated
+ * @details Only what has been collected by ksh_poll / ksh_wait so far. Valid until
+ * the next call on the job.
+ */
+const char* ksh_job_output(ksh_job *job, size_t *len){
+	if(len) *len = job->len;
+	if(!job->out) return "";
+	job->out[job->len] = '\0';
+	return job->out;
+}
+
+/**
+ * @brief Frees a job. One that is still running loses its output pipe and is waited for.
+ */
+void ksh_job_free(ksh_job *job){
+	if(job->fd != -1) close(job->fd);
+	if(!job->done) __ksh_collect(job, 0);
+	free(job->out);
+	free(job);
+}
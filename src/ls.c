@@ -5,8 +5,23 @@
 #define BIT_L (1<<1)
 #define INCLUDE_HIDDEN(X) (X & BIT_A)
 #define LIST_FORMAT(X) (X & BIT_L)
+#define BIT_U (1<<2)
+#define BIT_T (1<<3)
+#define BIT_S (1<<4)
+#define UNSORTED(X) (X & BIT_U)
+#define SORT_MTIME(X) (X & BIT_T)
+#define SORT_SIZE(X) (X & BIT_S)
+#define BIT_R (1<<5)
+#define RECURSIVE(X) (X & BIT_R)
+#define NEEDS_STAT(X) (X & (BIT_L | BIT_T | BIT_S))
 #define IGNORE(X, FLAG) (!INCLUDE_HIDDEN(FLAG) && X[0]=='.')
 
+// Size of the getdents64 buffer used by unsorted (streamed) listings
+#define LS_DENTS_BUF (1<<20)
+
+// Entries stat'd per worker chunk. Smaller directories are stat'd inline.
+#define LS_STAT_GRAIN 512
+
 // -------------------------------- Util functions --------------------------------
 
 /**
@@ -49,67 +64,138 @@ string get_perms(struct stat *sb){
 /**
  * @brief Print details of a file in ls -l format
  * 
- * @param filepath Path to file from cwd
- * @param filename Name to display on last column
+ * @param out Buffer to print into
+ * @param e Entry holding the name and the stat struct of the file
  */
-void __print_list_file(string filepath, string filename){
-
-	// Read stat struct
-	struct stat sb;
-	if(check_perror("ls", lstat(filepath, &sb), -1)) return;
+void __print_list_file(out_buffer *out, ls_entry *e){
+
+	// Report files we failed to stat here so errors show up in listing order. The shell's
+	// buffer is flushed first, capture buffers (ls -R workers) carry the message with the
+	// listing until their directory is emitted.
+	if(e->err){
+		errno = e->err;
+		if(out == &KSH.out) check_perror("ls", -1, -1);
+		else buf_printf(out, "ls: %s\n", strerror(e->err));
+		return;
+	}
+	struct stat *sb = &e->sb;
 
 	// Obtain perms string
-	string perms = get_perms(&sb);
+	string perms = get_perms(sb);
 	if(!perms) return;
 	
 	// Read st_mtime and format as required
 	char date[81];
+	struct tm tm;
 	time_t curtime = time(0);
-	if(llabs(curtime-sb.st_mtime) >= 15811200)
-		strftime(date, 80, "%b %d  %Y", localtime(&(sb.st_mtime)));
+	localtime_r(&(sb->st_mtime), &tm);
+	if(llabs(curtime-sb->st_mtime) >= 15811200)
+		strftime(date, 80, "%b %d  %Y", &tm);
 	else
-		strftime(date, 80, "%b %d %H:%M", localtime(&(sb.st_mtime)));
+		strftime(date, 80, "%b %d %H:%M", &tm);
+
+	// Resolve owner names through the session cache, unknown ids are printed as numbers
+	char uid[16], gid[16];
+	string user = uid_to_name(sb->st_uid);
+	string group = gid_to_name(sb->st_gid);
+	if(!user) { sprintf(uid, "%u", sb->st_uid); user = uid; }
+	if(!group) { sprintf(gid, "%u", sb->st_gid); group = gid; }
 
 	// Print output
-	printf("%s ", perms);
-	printf("%3ld ", sb.st_nlink);
-	printf("%8s ", getpwuid(sb.st_uid)->pw_name);
-	printf("%8s ", getgrgid(sb.st_gid)->gr_name);
-	printf("%10ld ", sb.st_size);
-	printf("%s ", date);
-    printf("%s\n", filename);
+	buf_printf(out, "%s %3ld %8s %8s %10ld %s %s\n", perms, sb->st_nlink, user, group, sb->st_size, date, e->name);
 
     // Cleanup
 	free(perms);
 }
 
+typedef struct stat_job{
+	int dirfd;
+	ls_dir *d;
+} stat_job;
+
 /**
- * @return Returns the total block size as displayed by the ls command
+ * @brief Worker for __stat_entries. Stats entries [begin, end) of the listing.
+ */
+void __stat_range(void *arg, uint32_t begin, uint32_t end){
+	stat_job *job = arg;
+	for(uint32_t i=begin; i < end; i++){
+		ls_entry *e = &job->d->entries[i];
+		e->name = pool_at(&job->d->names, i);
+		if(fstatat(job->dirfd, e->name, &e->sb, AT_SYMLINK_NOFOLLOW) == -1)
+			e->err = errno;
+	}
+}
+
+/**
+ * @brief Stats every name in the listing exactly once, relative to dirfd
+ * @details Fills the entry array and the block total of the listing. The
+ * entries are in the same order as the names. Large directories are stat'd
+ * by the worker pool since listing them is bound by stat latency.
+ * 
+ * @param dirfd Open fd of the directory the names live in. AT_FDCWD for paths.
+ * @param d Listing whose names are already populated
  */
-int64_t __get_total(string dirname, string_vector *v){
+void __stat_entries(int dirfd, ls_dir *d){
 	
-	int dirlen = strlen(dirname);
-	int64_t total = 0;
+	d->size = d->names.size;
+	d->entries = check_bad_alloc(calloc(max(d->size, 1), sizeof(ls_entry)));
+	d->total = 0;
 
-	for(int i=0; i < v->size; i++){
+	stat_job job = {dirfd, d};
+	parallel_for(d->size, LS_STAT_GRAIN, __stat_range, &job);
+
+	for(int i=0; i < d->size; i++)
+		if(!d->entries[i].err) d->total += d->entries[i].sb.st_blocks;
+
+	// Total is displayed in 1K blocks, st_blocks is in 512B units
+	d->total >>= 1;
+}
 
-		string filename = v->arr[i];
-		string path = check_bad_alloc(calloc(1, dirlen + strlen(filename) + 2));
-		// Generate filepath
-		strcpy(path, dirname);
-		if(dirname[dirlen-1] != '/') 
-			strcat(path, "/");
-		strcat(path, filename);
-
-		// Sum over all file blocksizes
-		struct stat sb;
-		if(check_perror("ls", lstat(path, &sb), -1)) return -1;
-		total += sb.st_blocks;
-		free(path);
+/**
+ * @brief Sorts a listing by name, or by mtime / size (largest first) with -t / -S
+ * @details -t and -S sort on the cached stat records, so the listing must have been
+ * stat'd. Names and stat records are permuted together.
+ */
+void __sort_dir(ls_dir *d, int flags){
+	uint32_t n = d->names.size;
+	uint32_t *perm;
+
+	if(SORT_MTIME(flags) || SORT_SIZE(flags)){
+		int64_t *keys = check_bad_alloc(malloc(max(n, 1) * sizeof(int64_t)));
+		for(uint32_t i=0; i<n; i++){
+			struct stat *sb = &d->entries[i].sb;
+			keys[i] = (SORT_SIZE(flags)) ? sb->st_size : sb->st_mtim.tv_sec * 1000000000LL + sb->st_mtim.tv_nsec;
+		}
+		string *view = pool_view(&d->names);
+		perm = sort_by_key(view, keys, n);
+		free(view);
+		free(keys);
+	}
+	else{
+		string *view = pool_view(&d->names);
+		perm = sort_names(view, n, CASE_INSENSITIVE_SORT);
+		free(view);
 	}
 
-	// Return total / 2
-	return total>>1;
+	// Only the index of the name pool moves, entry names point into its arena
+	apply_permutation(d->names.index, sizeof(pool_slot), perm, n);
+	if(d->entries) apply_permutation(d->entries, sizeof(ls_entry), perm, n);
+	if(d->types) apply_permutation(d->types, sizeof(uint8_t), perm, n);
+	free(perm);
+}
+
+/**
+ * @brief Frees the names and stat records of a listing
+ */
+void __destroy_dir(ls_dir *d){
+	// Cached listings belong to the listing cache
+	if(d->cached) return;
+	destroy_pool(&d->names);
+	free(d->entries);
+	free(d->types);
+	d->entries = NULL;
+	d->types = NULL;
+	d->size = d->types_size = 0;
 }
 
 /**
@@ -117,7 +203,7 @@ int64_t __get_total(string dirname, string_vector *v){
  * @details Sets the flags variable. Error checks invalid file paths. Populates
  * files and directory vectors appropriately 
  */
-int __ls_parse_arguments(Command *c, string_vector *directories, string_vector *files, uint8_t *FLAG){
+int __ls_parse_arguments(Command *c, string_vector *directories, string_pool *files, uint8_t *FLAG){
 
 	uint8_t flags = 0;
 	int dir_parsed = 0;
@@ -135,6 +221,21 @@ int __ls_parse_arguments(Command *c, string_vector *directories, string_vector *
 					case 'a':
 						flags |= BIT_A;
 					break;
+					case 'U':
+						flags |= BIT_U;
+					break;
+					case 'f':
+						flags |= BIT_U | BIT_A;
+					break;
+					case 't':
+						flags = (flags & ~BIT_S) | BIT_T;
+					break;
+					case 'S':
+						flags = (flags & ~BIT_T) | BIT_S;
+					break;
+					case 'R':
+						flags |= BIT_R;
+					break;
 					default:
 						throw_error(BAD_FLAGS);
 						return -1;
@@ -155,22 +256,17 @@ int __ls_parse_arguments(Command *c, string_vector *directories, string_vector *
 				return -1;
 			}
 			struct stat sb;
-			if(check_perror(buf, lstat(c->argv.arr[i], &sb), -1)) continue;
-			if(S_ISREG(sb.st_mode)){
-				push_back(files, c->argv.arr[i]);
-				free(buf);
-				continue;
-			}
-
-			// If given path is not a directory we can open, write error to terminal
-			DIR *tmp;
-			if(check_perror(buf, (long long) (tmp = opendir(c->argv.arr[i])), 0)){
-				free(buf); continue;
-			}
+			if(check_perror(buf, lstat(c->argv.arr[i], &sb), -1)) { free(buf); continue; }
 			free(buf);
-			if(check_perror("ls", closedir(tmp), -1)) continue;
-			// Valid directory, populate directory vector
-			push_back(directories, c->argv.arr[i]);
+
+			// Symlinks given as arguments are followed if they point to a directory.
+			// Directories are only opened once, when they are listed.
+			if(S_ISLNK(sb.st_mode) && stat(c->argv.arr[i], &sb) == -1)
+				sb.st_mode = S_IFLNK;
+			if(S_ISDIR(sb.st_mode))
+				push_back(directories, c->argv.arr[i]);
+			else
+				pool_push(files, c->argv.arr[i], strlen(c->argv.arr[i]));
 		}
 	}
 	*FLAG = flags;
@@ -182,52 +278,106 @@ int __ls_parse_arguments(Command *c, string_vector *directories, string_vector *
  * 
  * @param files Vector containing the file names
  */
-void __print_single_files(string_vector *files, int flags){
+void __print_single_files(ls_dir *files, int flags){
 	
-	if(!files->size) return; // No files to output
+	if(!files->names.size) return; // No files to output
+
+	if(NEEDS_STAT(flags))
+		__stat_entries(AT_FDCWD, files);
+	if(!UNSORTED(flags))
+		__sort_dir(files, flags);
 
 	// Output all singleton files 
-	for(int i=0; i<files->size; i++){
-		if(LIST_FORMAT(flags))
-			__print_list_file(files->arr[i], files->arr[i]);
-		else
-			printf("%s  ", files->arr[i]);
+	if(LIST_FORMAT(flags)){
+		for(int i=0; i<files->size; i++)
+			__print_list_file(&KSH.out, &files->entries[i]);
+	}
+	else{
+		for(int i=0; i<files->names.size; i++)
+			bprintf("%s  ", pool_at(&files->names, i));
 	}
-	printf("\n");
+	bprintf("\n");
 }
 
 /**
- * @brief Populates vector with files from directory
- * @details Reads all required flags from directory as per the flags passed and
- * pushes it into the list string vector
+ * @brief Populates a listing with the files from directory
+ * @details Reads all required files from directory as per the flags passed, stats
+ * each of them once relative to the open directory if needed and sorts them.
+ * Errors are not printed but saved in list->err, so listings can be read from
+ * any thread and reported in order.
  * 
  * @param dirname Name of the directory to read files from
- * @param list Pointer to vector to populate
+ * @param list Pointer to listing to populate
  */
-int __read_dir(string dirname, string_vector *list, int flags){
+int __read_dir(string dirname, ls_dir *list, int flags){
+
+	create_pool(&list->names, 16, 256);
+	list->types = NULL;
+	list->types_size = 0;
+	list->entries = NULL;
+	list->size = 0;
+	list->total = 0;
+	list->err = 0;
+	list->cached = false;
+
 	// Open directory
 	DIR *d;
-	if(check_perror("ls", (long long) (d = opendir(dirname)), 0)) return -1;
+	if(!(d = opendir(dirname))){
+		list->err = errno;
+		return -1;
+	}
 
 	errno = 0; // Set errno to 0 so we can distinguish between end of stream and error
 	struct dirent *dir;
 	
 	// Populate all files into vector
-	create_vector(list, 4);
 	while((dir = readdir(d))){
 		if(IGNORE(dir->d_name, flags)) continue;
-		push_back(list, dir->d_name);
+		pool_push(&list->names, dir->d_name, strlen(dir->d_name));
+		// Keep d_type alongside the names, -R uses it to find subdirectories
+		if(list->names.table_size != list->types_size){
+			list->types_size = list->names.table_size;
+			list->types = check_bad_alloc(realloc(list->types, list->types_size));
+		}
+		list->types[list->names.size-1] = dir->d_type;
+	}
+	if(errno){
+		list->err = errno;
+		closedir(d);
+		return -1;
 	}
+
+	// Single stat pass while the directory is still open
+	if(NEEDS_STAT(flags))
+		__stat_entries(dirfd(d), list);
+
+	// Sort all files irrespective of case for pretty printing, or on stat fields
+	if(!UNSORTED(flags))
+		__sort_dir(list, flags);
 	
 	// Handle errors and cleanup
-	if(check_perror("ls", closedir(d), -1)) return -1;
-	if(errno){
-		perror("ls");
+	if(closedir(d) == -1){
+		list->err = errno;
 		return -1;
 	}
 	return 0;
 }
 
+typedef struct read_job{
+	string_vector *dirnames;
+	ls_dir *lists;
+	int flags;
+} read_job;
+
+/**
+ * @brief Worker for ls. Reads directories [begin, end) into their listings.
+ */
+void __read_dir_range(void *arg, uint32_t begin, uint32_t end){
+	read_job *job = arg;
+	for(uint32_t i=begin; i < end; i++)
+		if(!job->lists[i].cached) __read_dir(job->dirnames->arr[i], &job->lists[i], job->flags);
+}
+
 // -------------------------------- Util functions --------------------------------
 
 
@@ -235,46 +385,140 @@ int __read_dir(string dirname, string_vector *list, int flags){
  * @brief ls -l print command
  * @details Can handle the -a flag. Handles list format
  * 
- * @param d DIR* Pointer to the directory stream of the directory to print
- * @param flags bitmask for the -a flag. Portable to more. 
+ * @param out Buffer to print into
+ * @param d Listing populated by __read_dir with the list format flag
  */
-void __printdir_list(string dirname, string_vector *v){
-	
-	int dirlen = strlen(dirname);
+void __printdir_list(out_buffer *out, ls_dir *d){
+	for(int i=0; i < d->size; i++)
+		__print_list_file(out, &d->entries[i]);
+}
 
-	for(int i=0; i < v->size; i++){
-		// Variable setup / allocation
-		string filename = v->arr[i];
-		string path = check_bad_alloc(calloc(1, dirlen + strlen(filename) + 2));
-
-		// Generate filepath from directory path and filename
-		strcpy(path, dirname);
-		if(dirname[dirlen-1] != '/') 
-			strcat(path, "/");
-		strcat(path, filename);
-
-		// Print file output in list format
-		__print_list_file(path, filename);
-		free(path);
+/**
+ * @brief ls -f / -U print command
+ * @details Reads the directory with getdents64 into a fixed size buffer and writes
+ * each name through the output buffer as it is read, in directory order. Memory use 
+ * is constant and output is flushed after every batch of entries. With -l each entry
+ * is stat'd on the spot, so no `total` line can be printed ahead of the entries.
+ * 
+ * @return 0 on success, -1 on failure
+ */
+int __printdir_stream(string dirname, int flags){
+	int fd;
+	if(check_perror("ls", fd = open(dirname, O_RDONLY | O_DIRECTORY), -1)) return -1;
+
+	string buf = check_bad_alloc(malloc(LS_DENTS_BUF));
+	long nread;
+	ls_entry e;
+	while((nread = syscall(SYS_getdents64, fd, buf, LS_DENTS_BUF)) > 0){
+		for(long pos = 0; pos < nread;){
+			struct linux_dirent64 *dent = (struct linux_dirent64*) (buf + pos);
+			pos += dent->d_reclen;
+			if(IGNORE(dent->d_name, flags)) continue;
+
+			if(LIST_FORMAT(flags)){
+				e.name = dent->d_name;
+				e.err = (fstatat(fd, e.name, &e.sb, AT_SYMLINK_NOFOLLOW) == -1) ? errno : 0;
+				__print_list_file(&KSH.out, &e);
+			}
+			else{
+				buf_write(&KSH.out, dent->d_name, strlen(dent->d_name));
+				buf_write(&KSH.out, "  ", 2);
+			}
+		}
+		bflush();
 	}
+	check_perror("ls", nread, -1);
 
+	free(buf);
+	close(fd);
+	return (nread == -1) ? -1 : 0;
 }
 
 /**
  * @brief The default ls command
  * @details Can handle the -a flag. Does NOT handle list format.
  * 
- * @param d DIR* Pointer to the directory stream of the directory to print
- * @param flags bitmask for the -a flag. Portable to more. 
+ * @param out Buffer to print into
+ * @param v Names to print
  */
-void __printdir_dfl(string_vector *v){
+void __printdir_dfl(out_buffer *out, string_pool *v){
 	
-	// Print them now :)
-	for(int i=0; i < v->size; i++)
-		if(printf("%s  ", v->arr[i]) < 0) 
-			throw_error(PRINTF_FAIL);
+	// Print them now :) Lengths are known, no need to go through printf
+	for(int i=0; i < v->size; i++){
+		buf_write(out, pool_at(v, i), pool_len(v, i));
+		buf_write(out, "  ", 2);
+	}
+}
+
+
+typedef struct ls_walk{
+	int flags;
+	bool first;
+} ls_walk;
+
+/**
+ * @brief Checks if the i-th entry of the listing of dirname is a directory
+ * @details Uses the stat records if the listing has them, d_type otherwise.
+ * Falls back to lstat if the filesystem does not report d_type.
+ */
+bool __is_subdir(string dirname, ls_dir *d, uint32_t i){
+	string name = pool_at(&d->names, i);
+	if(!strcmp(name, ".") || !strcmp(name, "..")) return false;
+	if(d->entries) return !d->entries[i].err && S_ISDIR(d->entries[i].sb.st_mode);
+	if(d->types[i] != DT_UNKNOWN) return d->types[i] == DT_DIR;
+
+	struct stat sb;
+	string path = check_bad_alloc(malloc(strlen(dirname) + strlen(name) + 2));
+	sprintf(path, "%s/%s", dirname, name);
+	bool ret = (lstat(path, &sb) == 0 && S_ISDIR(sb.st_mode));
+	free(path);
+	return ret;
+}
+
+/**
+ * @brief Walker visitor for ls -R. Runs on a worker thread.
+ * @details Reads and renders one directory into the node's buffer and adds its
+ * subdirectories as children, in listing order.
+ */
+void __ls_visit(walker *w, walk_node *node){
+	int flags = ((ls_walk*) w->arg)->flags;
+	ls_dir list;
+	if(__read_dir(node->path, &list, flags) == -1){
+		node->err = list.err;
+		__destroy_dir(&list);
+		return;
+	}
+
+	if(LIST_FORMAT(flags)){
+		buf_printf(&node->out, "total %ld\n", list.total);
+		__printdir_list(&node->out, &list);
+	}
+	else
+		__printdir_dfl(&node->out, &list.names);
+
+	for(uint32_t i=0; i<list.names.size; i++)
+		if(__is_subdir(node->path, &list, i)) walk_add_child(node, pool_at(&list.names, i));
+	__destroy_dir(&list);
 }
 
+/**
+ * @brief Walker callback for ls -R. Prints a visited directory, in depth first order.
+ */
+void __ls_emit(walker *w, walk_node *node){
+	ls_walk *state = w->arg;
+	if(!state->first) bprintf("\n");
+	state->first = false;
+
+	bprintf("%s:\n", node->path);
+	if(node->err){
+		errno = node->err;
+		check_perror("ls", -1, -1);
+		return;
+	}
+	if(node->out.used) buf_write(&KSH.out, node->out.buf, node->out.used);
+	bprintf("\n");
+	destroy_buffer(&node->out);
+}
 
 /**
  * @brief The main ls function that is called when parser detects ls
@@ -284,60 +528,117 @@ void __printdir_dfl(string_vector *v){
 int ls(Command *c){
 	// Init command state vars
 	uint8_t flags = 0;
-	string_vector directories, files;
+	string_vector directories;
+	ls_dir files = {0};
 	create_vector(&directories, 2);
-	create_vector(&files, 2);
+	create_pool(&files.names, 2, 0);
 	int dirs_received = 0;
 
 	// Parse arguments & return if error
-	dirs_received = __ls_parse_arguments(c, &directories, &files, &flags);
-	if(dirs_received==-1) return -1;
+	dirs_received = __ls_parse_arguments(c, &directories, &files.names, &flags);
+	if(dirs_received==-1){
+		destroy_vector(&directories);
+		__destroy_dir(&files);
+		return -1;
+	}
 
 	// If no directories specified, ls on cwd
 	if(dirs_received == 0) push_back(&directories, ".");
 
-	vec_sort(&directories, CASE_INSENSITIVE_SORT);
-	vec_sort(&files, CASE_INSENSITIVE_SORT);
+	if(!UNSORTED(flags))
+		vec_sort(&directories, CASE_INSENSITIVE_SORT);
 
 	__print_single_files(&files, flags);
 
-	if(files.size && directories.size) printf("\n"); // Pretty printing
+	if(files.names.size && directories.size) bprintf("\n"); // Pretty printing
 
-	// Iterate over all directories
-	for(int i=0; i<directories.size; i++){
-		// If multiple directories, print directory name
-		if(directories.size > 1){
-			if(printf("%s:\n", directories.arr[i]) < 0){
+	// Recursive listings walk all operands with the parallel tree walker
+	if(RECURSIVE(flags)){
+		ls_walk state = {flags, true};
+		walker w = {0};
+		w.visit = __ls_visit;
+		w.pre = __ls_emit;
+		w.arg = &state;
+		walk_tree(&w, directories.arr, directories.size);
+	}
+	// Unsorted listings are streamed one directory at a time, in operand order
+	else if(UNSORTED(flags)){
+		for(int i=0; i<directories.size; i++){
+			if(directories.size > 1 && bprintf("%s:\n", directories.arr[i]) < 0)
 				throw_error(PRINTF_FAIL);
-				return -1;
-			}
+			__printdir_stream(directories.arr[i], flags);
+			if(bprintf("\n") < 0) throw_error(PRINTF_FAIL);
+			if(i!=directories.size-1) if(bprintf("\n") < 0) throw_error(PRINTF_FAIL);
 		}
+	}
+	else{
+		// Directories are read and stat'd concurrently, a batch of one per worker at a 
+		// time. Each batch is then printed in order.
+		uint32_t batch = num_workers();
+		ls_dir *lists = check_bad_alloc(calloc(batch, sizeof(ls_dir)));
+		string_vector window;
+
+		for(int first=0; first<directories.size; first+=batch){
+			uint32_t cnt = min(batch, directories.size - first);
+			window.arr = &directories.arr[first];
+			window.size = window.table_size = cnt;
+
+			// Serve what we can from the listing cache, read the rest
+			struct stat *dsb = check_bad_alloc(malloc(cnt * sizeof(struct stat)));
+			if(KSH.dcache.enabled) dircache_sync(&KSH.dcache);
+			for(int i=0; i<cnt; i++){
+				ls_dir *hit = (KSH.dcache.enabled) ? dircache_get(&KSH.dcache, window.arr[i], flags, &dsb[i]) : NULL;
+				if(hit) lists[i] = *hit;
+				lists[i].cached = (hit != NULL);
+			}
+			read_job job = {&window, lists, flags};
+			parallel_for(cnt, 1, __read_dir_range, &job);
+			for(int i=0; i<cnt && KSH.dcache.enabled; i++){
+				if(lists[i].cached || lists[i].err) continue;
+				ls_dir *copy = check_bad_alloc(malloc(sizeof(ls_dir)));
+				*copy = lists[i];
+				if(dircache_put(&KSH.dcache, window.arr[i], flags, &dsb[i], copy)) lists[i].cached = true;
+				else free(copy);
+			}
+			free(dsb);
+
+			// Iterate over all directories
+			for(int i=first; i<first+cnt; i++){
+				ls_dir *list = &lists[i-first];
+
+				// If multiple directories, print directory name
+				if(directories.size > 1 && bprintf("%s:\n", directories.arr[i]) < 0)
+					throw_error(PRINTF_FAIL);
+
+				// Skip if error
+				if(list->err){
+					errno = list->err;
+					check_perror("ls", -1, -1);
+					__destroy_dir(list);
+					continue;
+				}
 
-		// Read files into vector. Skip if error. 
-		string_vector list;
-		if(__read_dir(directories.arr[i], &list, flags) == -1) continue;
-
-		// Sort all files irrespective of case for pretty printing
-		vec_sort(&list, CASE_INSENSITIVE_SORT);
-
-		// Print total number of blocks required
-		if(LIST_FORMAT(flags))
-			printf("total %ld\n", __get_total(directories.arr[i], &list));
+				// Print total number of blocks required
+				if(LIST_FORMAT(flags))
+					bprintf("total %ld\n", list->total);
 
-		// Print directory contents
-		if(!LIST_FORMAT(flags))
-			__printdir_dfl(&list);
-		else 
-			__printdir_list(directories.arr[i], &list);
+				// Print directory contents
+				if(!LIST_FORMAT(flags))
+					__printdir_dfl(&KSH.out, &list->names);
+				else 
+					__printdir_list(&KSH.out, list);
 
-		// Cleanup & handle errors
-		destroy_vector(&list);
-		if(printf("\n") < 0) throw_error(PRINTF_FAIL);
-		if(i!=directories.size-1) if(printf("\n") < 0) throw_error(PRINTF_FAIL);
+				// Cleanup & handle errors
+				__destroy_dir(list);
+				if(bprintf("\n") < 0) throw_error(PRINTF_FAIL);
+				if(i!=directories.size-1) if(bprintf("\n") < 0) throw_error(PRINTF_FAIL);
+			}
+		}
+		free(lists);
 	}
 
 	// Cleanup
 	destroy_vector(&directories);
-	destroy_vector(&files);
+	__destroy_dir(&files);
 	return 0;
 }
\ No newline at end of file
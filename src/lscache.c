@@ -0,0 +1,187 @@
+/**
+ * This is the code for the (opt-in) ls listing cache. Sorted listings and their
+ * stat records are kept per directory, keyed by (dev, ino) and the flags that
+ * shaped them. Entries are invalidated by inotify watches on the directories, or
+ * by comparing the mtime / ctime of the directory if a watch can't be added.
+ */
+
+#include "libs.h"
+#include "lscache.h"
+
+/**
+ * @brief Initializes an empty, disabled cache
+ */
+void create_dircache(dir_cache *c){
+	memset(c, 0, sizeof(dir_cache));
+	c->ifd = -1;
+}
+
+/**
+ * @brief Removes the i-th entry. Its watch is dropped if no other entry shares it.
+ */
+void __dircache_remove(dir_cache *c, uint32_t i){
+	dir_cache_entry *e = &c->entries[i];
+	bool shared = false;
+	for(uint32_t j=0; j<c->size; j++)
+		if(j != i && c->entries[j].wd == e->wd) shared = true;
+	if(e->wd != -1 && !shared) inotify_rm_watch(c->ifd, e->wd);
+
+	__destroy_dir(e->list);
+	free(e->list);
+	c->entries[i] = c->entries[--c->size];
+}
+
+/**
+ * @brief Drops every cached listing
+ */
+void dircache_clear(dir_cache *c){
+	while(c->size) __dircache_remove(c, c->size - 1);
+}
+
+/**
+ * @brief Drops every cached listing and closes the inotify instance
+ */
+void destroy_dircache(dir_cache *c){
+	dircache_clear(c);
+	if(c->ifd != -1) close(c->ifd);
+	c->ifd = -1;
+	c->enabled = false;
+}
+
+/**
+ * @brief Drains pending inotify events and invalidates the listings they concern
+ */
+void dircache_sync(dir_cache *c){
+	if(c->ifd == -1) return;
+
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+	while((len = read(c->ifd, buf, sizeof(buf))) > 0){
+		for(char *ptr = buf; ptr < buf + len;){
+			struct inotify_event *ev = (struct inotify_event*) ptr;
+			ptr += sizeof(struct inotify_event) + ev->len;
+			for(uint32_t i=0; i<c->size;){
+				if(c->entries[i].wd == ev->wd){
+					// The kernel already dropped the watch if the directory itself went away
+					if(ev->mask & (IN_IGNORED | IN_DELETE_SELF)) c->entries[i].wd = -1;
+					__dircache_remove(c, i);
+					c->invalidations++;
+				}
+				else i++;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Looks up the listing of dirname made with flags
+ * @details Entries without a watch are validated against the mtime / ctime of the
+ * directory. Call dircache_sync first.
+ * 
+ * @param sb Filled with the stat of dirname, pass it on to dircache_put on a miss
+ * @return The cached listing, owned by the cache. NULL on a miss.
+ */
+struct ls_dir* dircache_get(dir_cache *c, string dirname, int flags, struct stat *sb){
+	if(stat(dirname, sb) == -1){
+		sb->st_ino = 0;
+		return NULL;
+	}
+
+	for(uint32_t i=0; i<c->size; i++){
+		dir_cache_entry *e = &c->entries[i];
+		if(e->dev != sb->st_dev || e->ino != sb->st_ino || e->flags != flags) continue;
+
+		if(e->wd == -1 && (memcmp(&e->mtime, &sb->st_mtim, sizeof(struct timespec)) || 
+						   memcmp(&e->ctime, &sb->st_ctim, sizeof(struct timespec)))){
+			__dircache_remove(c, i);
+			c->invalidations++;
+			break;
+		}
+		e->age = ++c->clock;
+		c->hits++;
+		return e->list;
+	}
+	c->misses++;
+	return NULL;
+}
+
+/**
+ * @brief Caches a listing read after a miss in dircache_get. Takes ownership of it.
+ * @details The least recently used listing is evicted when the cache is full. A
+ * listing is not cached if the directory changed while it was being read.
+ * 
+ * @param sb Stat of dirname filled by dircache_get before the listing was read
+ * @param list Heap allocated listing to cache. Left to the caller if it isn't cached.
+ * @return true if the cache took ownership of list
+ */
+bool dircache_put(dir_cache *c, string dirname, int flags, struct stat *sb, struct ls_dir *list){
+	
+	// Watch first, then make sure nothing changed since the listing was read
+	int wd = (c->ifd == -1) ? -1 : inotify_add_watch(c->ifd, dirname, DIRCACHE_EVENTS | IN_ONLYDIR);
+	struct stat now;
+	if(!sb->st_ino || stat(dirname, &now) == -1 || now.st_ino != sb->st_ino || 
+	   memcmp(&now.st_mtim, &sb->st_mtim, sizeof(struct timespec)) || 
+	   memcmp(&now.st_ctim, &sb->st_ctim, sizeof(struct timespec))){
+		bool shared = false;
+		for(uint32_t i=0; i<c->size; i++)
+			if(c->entries[i].wd == wd) shared = true;
+		if(wd != -1 && !shared) inotify_rm_watch(c->ifd, wd);
+		return false;
+	}
+
+	if(c->size == DIRCACHE_SIZE){
+		uint32_t lru = 0;
+		for(uint32_t i=1; i<c->size; i++)
+			if(c->entries[i].age < c->entries[lru].age) lru = i;
+		__dircache_remove(c, lru);
+	}
+
+	dir_cache_entry *e = &c->entries[c->size++];
+	e->dev = sb->st_dev;
+	e->ino = sb->st_ino;
+	e->flags = flags;
+	e->wd = wd;
+	e->mtime = sb->st_mtim;
+	e->ctime = sb->st_ctim;
+	e->list = list;
+	e->age = ++c->clock;
+	return true;
+}
+
+/**
+ * @brief Controls the ls listing cache
+ * @details Usage: `lscache [on|off|clear]`. Without arguments prints whether the cache
+ * is enabled along with its size and hit / miss / invalidation counts.
+ * 
+ * @return 0 on success. -1 on failure.
+ */
+int lscache(Command *c){
+	dir_cache *dc = &KSH.dcache;
+	if(c->argc > 1){
+		throw_error(TOO_MANY_ARGS);
+		return -1;
+	}
+
+	if(c->argc == 0){
+		bprintf("%s, %u directories (%s)\n", (dc->enabled) ? "enabled" : "disabled", dc->size,
+				(dc->ifd != -1) ? "inotify" : "mtime checks");
+		bprintf("%lu hits, %lu misses, %lu invalidations\n", dc->hits, dc->misses, dc->invalidations);
+		return 0;
+	}
+
+	string arg = c->argv.arr[1];
+	if(!strcmp(arg, "on")){
+		if(!dc->enabled && dc->ifd == -1)
+			dc->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		dc->enabled = true;
+	}
+	else if(!strcmp(arg, "off"))
+		destroy_dircache(dc);
+	else if(!strcmp(arg, "clear"))
+		dircache_clear(dc);
+	else{
+		throw_error(BAD_ARGS);
+		return -1;
+	}
+	return 0;
+}
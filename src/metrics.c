@@ -0,0 +1,355 @@
+/**
+ * This is the code for the metrics engine behind baywatch. Metrics are
+ * registered in a table, each reading one /proc source. A sampler opens
+ * every source its columns need once, and on each tick reads each of them
+ * once and fills one row with a value per column. Parsing works in place
+ * on the read buffers, nothing is allocated per sample.
+ */
+
+#include "libs.h"
+#include "metrics.h"
+
+const char *proc_paths[SRC_COUNT] = {"/proc/stat", "/proc/meminfo", "/proc/interrupts",
+									 "/proc/loadavg", "/proc/diskstats", "/proc/net/dev"};
+
+// -------------------------------- Util functions --------------------------------
+
+/**
+ * @brief Parses the next unsigned number at *ptr, skipping blanks. Advances *ptr.
+ * @return The number, -1 if there is no number before the end of the line
+ */
+int64_t __next_num(char **ptr){
+	char *p = *ptr;
+	while(*p == ' ' || *p == '\t') p++;
+	if(!isdigit(*p)){
+		*ptr = p;
+		return -1;
+	}
+	int64_t num = 0;
+	for(; isdigit(*p); p++)
+		num = num*10 + (*p - '0');
+	*ptr = p;
+	return num;
+}
+
+/**
+ * @brief Skips the next blank separated word at *ptr
+ */
+void __skip_word(char **ptr){
+	char *p = *ptr;
+	while(*p == ' ' || *p == '\t') p++;
+	while(*p && !isspace(*p)) p++;
+	*ptr = p;
+}
+
+/**
+ * @brief Checks whether the word of length n at name is one of the listed devices
+ */
+bool __is_device(sampler *s, metric *m, const char *name, size_t n){
+	if(m->arg[0]) return strlen(m->arg) == n && !strncmp(m->arg, name, n);
+	for(uint32_t i=0; i<s->ndevices; i++)
+		if(strlen(s->devices[i]) == n && !strncmp(s->devices[i], name, n)) return true;
+	return false;
+}
+
+// -------------------------------- Metrics --------------------------------
+
+/**
+ * @brief Busy share of all CPUs since the last sample, in tenths of a percent
+ * @details Idle and iowait time count as idle, everything else on the
+ * aggregate `cpu` line of /proc/stat as busy.
+ */
+int64_t __m_cpu(metric *m, char *buf){
+	char *ptr = proc_find_line(buf, "cpu ");
+	if(!ptr) return 0;
+	ptr += 4;
+	int64_t total = 0, idle = 0, num;
+	for(int i=0; i<8 && (num = __next_num(&ptr)) != -1; i++){
+		total += num;
+		if(i == 3 || i == 4) idle += num;
+	}
+	int64_t dtotal = total - m->prev[0], didle = idle - m->prev[1];
+	m->prev[0] = total;
+	m->prev[1] = idle;
+	return (dtotal > 0) ? (dtotal - didle) * 1000 / dtotal : 0;
+}
+
+/**
+ * @brief First number on the line starting with the key of the metric
+ */
+int64_t __m_field(metric *m, char *buf){
+	char *ptr = proc_find_line(buf, m->def->key);
+	if(!ptr) return 0;
+	ptr = strstr(ptr, m->def->key) + strlen(m->def->key);
+	int64_t num = __next_num(&ptr);
+	return (num == -1) ? 0 : num;
+}
+
+/**
+ * @brief Memory in use, MemTotal - MemAvailable in kB
+ */
+int64_t __m_mem(metric *m, char *buf){
+	proc_meminfo mem;
+	procfs_parse_meminfo(buf, &mem, PM_TOTAL | PM_AVAILABLE);
+	return mem.total - mem.available;
+}
+
+/**
+ * @brief Dirty page cache in kB
+ */
+int64_t __m_dirty(metric *m, char *buf){
+	proc_meminfo mem;
+	procfs_parse_meminfo(buf, &mem, PM_DIRTY);
+	return mem.dirty;
+}
+
+/**
+ * @brief Pid of the process most recently created on the system
+ */
+int64_t __m_newborn(metric *m, char *buf){
+	proc_loadavg l;
+	return (procfs_parse_loadavg(buf, &l) == -1) ? 0 : l.last_pid;
+}
+
+/**
+ * @brief Interrupts of one IRQ summed over all CPUs
+ * @details The IRQ is the argument of the metric, or its key for aliases.
+ */
+int64_t __m_irq(metric *m, char *buf){
+	int64_t count;
+	procfs_parse_irq(buf, (m->arg[0]) ? m->arg : m->def->key, &count);
+	return count;
+}
+
+/**
+ * @brief Bytes read from / written to disk devices, from the sector counts in /proc/diskstats
+ * @details Sums one device if given as argument, all whole disks (/sys/block) otherwise
+ * so partitions aren't counted twice.
+ */
+int64_t __m_disk(metric *m, char *buf){
+	int field = (m->def->key[0] == 'r') ? 3 : 7;
+	int64_t sum = 0;
+	for(char *line = buf; line && *line;){
+		char *ptr = line;
+		__skip_word(&ptr);
+		__skip_word(&ptr);
+		while(*ptr == ' ') ptr++;
+		char *name = ptr;
+		__skip_word(&ptr);
+		if(__is_device(m->owner, m, name, ptr - name)){
+			int64_t num = 0;
+			for(int i=1; i<=field && num != -1; i++) num = __next_num(&ptr);
+			if(num != -1) sum += num;
+		}
+		line = strchr(line, '\n');
+		if(line) line++;
+	}
+	return sum * 512;
+}
+
+/**
+ * @brief Bytes received / sent by network interfaces, from /proc/net/dev
+ * @details Sums one interface if given as argument, all but loopback otherwise.
+ */
+int64_t __m_net(metric *m, char *buf){
+	int field = (m->def->key[0] == 'r') ? 1 : 9;
+	int64_t sum = 0;
+	for(char *line = buf; line && *line;){
+		char *name = line, *colon = strchr(line, ':'), *eol = strchr(line, '\n');
+		while(*name == ' ') name++;
+		if(colon && (!eol || colon < eol)){
+			size_t n = colon - name;
+			bool match = (m->arg[0]) ? (strlen(m->arg) == n && !strncmp(m->arg, name, n)) :
+									   !(n == 2 && !strncmp(name, "lo", 2));
+			if(match){
+				char *ptr = colon + 1;
+				int64_t num = 0;
+				for(int i=1; i<=field && num != -1; i++) num = __next_num(&ptr);
+				if(num != -1) sum += num;
+			}
+		}
+		line = (eol) ? eol + 1 : NULL;
+	}
+	return sum;
+}
+
+const metric_def metric_defs[] = {
+	{"cpu", NULL, SRC_STAT, METRIC_GAUGE, 1, "CPU utilisation of all CPUs, %", __m_cpu},
+	{"ctxt", "ctxt ", SRC_STAT, METRIC_COUNTER, 0, "context switches/s", __m_field},
+	{"intr", "intr ", SRC_STAT, METRIC_COUNTER, 0, "interrupts/s, all IRQs", __m_field},
+	{"forks", "processes ", SRC_STAT, METRIC_COUNTER, 0, "processes created/s", __m_field},
+	{"mem", NULL, SRC_MEMINFO, METRIC_GAUGE, 0, "memory in use (MemTotal - MemAvailable), kB", __m_mem},
+	{"dirty", NULL, SRC_MEMINFO, METRIC_GAUGE, 0, "dirty page cache, kB", __m_dirty},
+	{"irq", NULL, SRC_INTERRUPTS, METRIC_COUNTER, 0, "irq:N interrupts/s of IRQ N, all CPUs", __m_irq},
+	{"interrupt", "1", SRC_INTERRUPTS, METRIC_COUNTER, 0, "keyboard controller (i8042) interrupts/s, irq:1", __m_irq},
+	{"newborn", NULL, SRC_LOADAVG, METRIC_GAUGE, 0, "pid of the most recently created process", __m_newborn},
+	{"disk_r", "r", SRC_DISKSTATS, METRIC_COUNTER, 0, "disk_r[:dev] bytes read/s, all disks by default", __m_disk},
+	{"disk_w", "w", SRC_DISKSTATS, METRIC_COUNTER, 0, "disk_w[:dev] bytes written/s, all disks by default", __m_disk},
+	{"net_rx", "r", SRC_NETDEV, METRIC_COUNTER, 0, "net_rx[:if] bytes received/s, all but lo by default", __m_net},
+	{"net_tx", "t", SRC_NETDEV, METRIC_COUNTER, 0, "net_tx[:if] bytes sent/s, all but lo by default", __m_net},
+	{NULL, NULL, 0, 0, 0, NULL, NULL}
+};
+
+// -------------------------------- Sampler --------------------------------
+
+/**
+ * @brief Initializes a sampler with no columns
+ */
+void create_sampler(sampler *s){
+	memset(s, 0, sizeof(sampler));
+	for(int i=0; i<SRC_COUNT; i++)
+		s->src[i].fd = -1;
+}
+
+/**
+ * @brief Closes all sources of the sampler
+ */
+void destroy_sampler(sampler *s){
+	for(int i=0; i<SRC_COUNT; i++)
+		proc_close(&s->src[i]);
+	s->ncols = 0;
+}
+
+/**
+ * @brief Adds a column to the sampler
+ * @details spec is a metric name, optionally followed by `:arg` (ex: irq:9, net_rx:eth0)
+ *
+ * @return 0 on success, -1 if the metric does not exist or there are too many columns
+ */
+int sampler_add(sampler *s, string spec){
+	if(s->ncols == METRICS_MAX || strlen(spec) >= METRIC_NAME_MAX) return -1;
+
+	char *colon = strchr(spec, ':');
+	size_t n = (colon) ? (size_t)(colon - spec) : strlen(spec);
+	const metric_def *d = metric_defs;
+	for(; d->name; d++)
+		if(strlen(d->name) == n && !strncmp(d->name, spec, n)) break;
+	if(!d->name) return -1;
+
+	// Only irq, disk and net metrics take an argument. irq needs one.
+	bool takes_arg = (d->read == __m_irq && !d->key) || d->read == __m_disk || d->read == __m_net;
+	if((colon && (!takes_arg || !colon[1])) || (!colon && d->read == __m_irq && !d->key)) return -1;
+
+	metric *m = &s->cols[s->ncols++];
+	memset(m, 0, sizeof(metric));
+	m->def = d;
+	m->owner = s;
+	strcpy(m->arg, (colon) ? colon + 1 : "");
+	strcpy(m->header, spec);
+	return 0;
+}
+
+/**
+ * @brief Opens the sources needed by the columns and takes a first sample
+ * @details The first sample only sets the baseline of counters, rows are
+ * meaningful from the next sample on.
+ *
+ * @return 0 on success, -1 on failure with errno set
+ */
+int sampler_open(sampler *s){
+	bool all_disks = false;
+	for(uint32_t i=0; i<s->ncols; i++){
+		metric *m = &s->cols[i];
+		proc_source *src = &s->src[m->def->source];
+		if(src->fd == -1 && proc_open(src, proc_paths[m->def->source]) == -1) return -1;
+		if(m->def->read == __m_disk && !m->arg[0]) all_disks = true;
+	}
+
+	// Whole disks are the ones with an entry in /sys/block
+	DIR *d;
+	if(all_disks && (d = opendir("/sys/block"))){
+		struct dirent *dir;
+		while((dir = readdir(d)) && s->ndevices < METRIC_DEVICES_MAX){
+			if(dir->d_name[0] == '.' || strlen(dir->d_name) >= METRIC_NAME_MAX) continue;
+			strcpy(s->devices[s->ndevices++], dir->d_name);
+		}
+		closedir(d);
+	}
+
+	metric_row row;
+	sampler_sample(s, &row);
+	return 0;
+}
+
+/**
+ * @brief Reads every source once and fills one row
+ * @details Counters are converted to rates per second over the time since
+ * the previous sample.
+ */
+void sampler_sample(sampler *s, metric_row *row){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t now_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+	s->elapsed_ns = (s->last_ns) ? now_ns - s->last_ns : 0;
+	s->last_ns = now_ns;
+	clock_gettime(CLOCK_REALTIME, &now);
+	row->time_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+
+	for(int i=0; i<SRC_COUNT; i++)
+		if(s->src[i].fd != -1) proc_read(&s->src[i]);
+
+	for(uint32_t i=0; i<s->ncols; i++){
+		metric *m = &s->cols[i];
+		int64_t val = m->def->read(m, s->src[m->def->source].buf);
+		if(m->def->kind == METRIC_COUNTER){
+			int64_t delta = val - m->prev[0];
+			m->prev[0] = val;
+			val = (s->elapsed_ns) ? (int64_t)((double) delta * 1e9 / s->elapsed_ns) : 0;
+		}
+		row->values[i] = val;
+	}
+}
+
+/**
+ * @brief Width of a column in the aligned table
+ */
+int __col_width(metric *m){
+	return max(strlen(m->header), 10);
+}
+
+/**
+ * @brief Prints the column names. A table starts with a time column, CSV with time_ms.
+ */
+void sampler_print_header(sampler *s, out_buffer *out, bool csv){
+	buf_printf(out, (csv) ? "time_ms" : "time        ");
+	for(uint32_t i=0; i<s->ncols; i++){
+		if(csv) buf_printf(out, ",%s", s->cols[i].header);
+		else buf_printf(out, "  %*s", __col_width(&s->cols[i]), s->cols[i].header);
+	}
+	buf_write(out, "\n", 1);
+}
+
+/**
+ * @brief Prints one row, as an aligned table line or as CSV
+ */
+void sampler_print_row(sampler *s, metric_row *row, out_buffer *out, bool csv){
+	if(csv) buf_printf(out, "%ld", row->time_ns / 1000000);
+	else{
+		time_t sec = row->time_ns / 1000000000;
+		struct tm tm;
+		localtime_r(&sec, &tm);
+		buf_printf(out, "%02d:%02d:%02d.%03ld", tm.tm_hour, tm.tm_min, tm.tm_sec,
+				   (row->time_ns / 1000000) % 1000);
+	}
+
+	for(uint32_t i=0; i<s->ncols; i++){
+		metric *m = &s->cols[i];
+		int64_t val = row->values[i];
+		int width = (csv) ? 0 : __col_width(m);
+		if(!csv) buf_write(out, "  ", 2);
+		else buf_write(out, ",", 1);
+		if(m->def->decimals)
+			buf_printf(out, "%*ld.%ld", max(width - 2, 0), val / 10, labs(val % 10));
+		else
+			buf_printf(out, "%*ld", width, val);
+	}
+	buf_write(out, "\n", 1);
+}
+
+/**
+ * @brief Prints the available metrics with a short description
+ */
+void metrics_print_list(out_buffer *out){
+	for(const metric_def *d = metric_defs; d->name; d++)
+		buf_printf(out, "%-10s %s\n", d->name, d->help);
+}
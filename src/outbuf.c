@@ -0,0 +1,175 @@
+/**
+ * This is the code for a simple output buffer used by the builtins. 
+ * stdout is unbuffered while the shell is running (see get_line) so every
+ * printf turns into a write syscall. Builtins instead print into an
+ * out_buffer which is flushed once at the end of the builtin, or earlier
+ * if the buffer fills up.
+ */
+
+#include "libs.h"
+#include "outbuf.h"
+
+/**
+ * @brief Writes len bytes to fd, retrying on partial writes and EINTR
+ * @return 0 on success, -1 on failure
+ */
+int __write_all(int fd, const char *data, size_t len){
+	while(len){
+		ssize_t w = write(fd, data, len);
+		if(w == -1){
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		data += w;
+		len -= w;
+	}
+	return 0;
+}
+
+/**
+ * @brief Grows a capture buffer so that it can hold at least req more bytes
+ */
+void __buf_reserve(out_buffer *b, size_t req){
+	if(b->used + req <= b->cap) return;
+	size_t cap = b->cap ? b->cap : 256;
+	while(b->used + req > cap) cap <<= 1;
+	b->buf = check_bad_alloc(realloc(b->buf, cap));
+	b->cap = cap;
+}
+
+/**
+ * @brief Creates the buffer
+ * 
+ * @param fd File descriptor the buffer flushes to. If OUTBUF_CAPTURE, the buffer
+ * never flushes and grows instead. The caller is free to read buf / used.
+ * @param cap Initial capacity of the buffer. Capture buffers may start at 0, they
+ * allocate on the first write (buf stays NULL until then).
+ */
+void create_buffer(out_buffer *b, int fd, size_t cap){
+	b->buf = cap ? check_bad_alloc(malloc(cap)) : NULL;
+	b->used = 0;
+	b->cap = cap;
+	b->fd = fd;
+}
+
+/**
+ * @brief Frees the buffer. Does NOT flush pending output.
+ */
+void destroy_buffer(out_buffer *b){
+	free(b->buf);
+	b->buf = NULL;
+	b->used = b->cap = 0;
+}
+
+/**
+ * @brief Writes all pending output to the fd of the buffer
+ * @return 0 on success, -1 on failure
+ */
+int buf_flush(out_buffer *b){
+	if(b->fd == OUTBUF_CAPTURE || !b->used) return 0;
+	int ret = __write_all(b->fd, b->buf, b->used);
+	b->used = 0;
+	return ret;
+}
+
+/**
+ * @brief Appends len bytes of data to the buffer
+ * @details Flushes first if the data does not fit. Data larger than the
+ * buffer itself is written straight through.
+ * 
+ * @return Number of bytes written on success, -1 on failure
+ */
+int buf_write(out_buffer *b, const char *data, size_t len){
+	if(b->fd == OUTBUF_CAPTURE)
+		__buf_reserve(b, len);
+	else if(b->used + len > b->cap){
+		if(buf_flush(b) == -1) return -1;
+		if(len >= b->cap)
+			return (__write_all(b->fd, data, len) == -1) ? -1 : (int) len;
+	}
+	memcpy(b->buf + b->used, data, len);
+	b->used += len;
+	return len;
+}
+
+/**
+ * @brief vprintf into the buffer
+ * @return Number of bytes written on success, -1 on failure
+ */
+int buf_vprintf(out_buffer *b, const char *format, va_list args){
+	va_list cpy;
+	va_copy(cpy, args);
+	size_t left = b->cap - b->used;
+	int n = vsnprintf(left ? b->buf + b->used : NULL, left, format, args);
+	if(n < 0){
+		va_end(cpy);
+		return -1;
+	}
+
+	// Common case, output fit in the remaining space
+	if((size_t) n < left){
+		b->used += n;
+		va_end(cpy);
+		return n;
+	}
+
+	// Make space and format again
+	if(b->fd == OUTBUF_CAPTURE)
+		__buf_reserve(b, n+1);
+	else if(buf_flush(b) == -1){
+		va_end(cpy);
+		return -1;
+	}
+
+	if((size_t) n < b->cap - b->used){
+		vsnprintf(b->buf + b->used, b->cap - b->used, format, cpy);
+		b->used += n;
+	}
+	else{
+		// Larger than the whole buffer, format separately and write through
+		string tmp = check_bad_alloc(malloc(n+1));
+		vsnprintf(tmp, n+1, format, cpy);
+		n = buf_write(b, tmp, n);
+		free(tmp);
+	}
+	va_end(cpy);
+	return n;
+}
+
+/**
+ * @brief printf into the buffer
+ * @return Number of bytes written on success, -1 on failure
+ */
+int buf_printf(out_buffer *b, const char *format, ...){
+	va_list args;
+	va_start(args, format);
+	int n = buf_vprintf(b, format, args);
+	va_end(args);
+	return n;
+}
+
+/**
+ * @brief printf into the shell's output buffer
+ */
+int bprintf(const char *format, ...){
+	va_list args;
+	va_start(args, format);
+	int n = buf_vprintf(&KSH.out, format, args);
+	va_end(args);
+	return n;
+}
+
+/**
+ * @brief puts into the shell's output buffer
+ */
+int bputs(const char *str){
+	if(buf_write(&KSH.out, str, strlen(str)) == -1) return -1;
+	return buf_write(&KSH.out, "\n", 1);
+}
+
+/**
+ * @brief Flushes the shell's output buffer
+ */
+int bflush(){
+	return buf_flush(&KSH.out);
+}
@@ -0,0 +1,81 @@
+/**
+ * This is the code for a minimal fork-join worker pool. parallel_for splits
+ * [0, n) into chunks of `grain` items which are handed out to worker threads
+ * until none are left. The calling thread works as well and returns once
+ * every chunk has been processed. Calls made from inside a parallel_for (or
+ * another pool's worker) run inline, so nesting doesn't multiply the threads.
+ */
+
+#include "libs.h"
+#include "parallel.h"
+
+typedef struct range_job{
+	uint32_t n;
+	uint32_t grain;
+	uint32_t next;
+	range_fn fn;
+	void *arg;
+	Shell *ctx;
+} range_job;
+
+_Thread_local bool in_parallel = false;
+
+/**
+ * @brief Returns the number of threads worth running on this machine
+ */
+uint32_t num_workers(){
+	static uint32_t workers = 0;
+	if(!workers){
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		workers = (cpus < 1) ? 1 : min(cpus, MAX_WORKERS);
+	}
+	return workers;
+}
+
+/**
+ * @brief Worker loop. Claims chunks until the range is exhausted.
+ */
+void *__range_worker(void *j){
+	range_job *job = j;
+	ksh_ctx = job->ctx;
+	bool nested = in_parallel;
+	in_parallel = true;
+	uint32_t begin, end;
+	while((begin = __atomic_fetch_add(&job->next, job->grain, __ATOMIC_RELAXED)) < job->n){
+		end = (job->n - begin > job->grain) ? begin + job->grain : job->n;
+		job->fn(job->arg, begin, end);
+	}
+	in_parallel = nested;
+	return NULL;
+}
+
+/**
+ * @brief Calls fn over [0, n) split into chunks, spread over the worker threads
+ * @details Small ranges (a single chunk), single core machines and calls from a
+ * thread that is itself a worker run inline. If a thread cannot be created the
+ * remaining threads pick up its share.
+ * 
+ * @param n Number of items
+ * @param grain Number of items handed to a worker at a time
+ * @param fn Called as fn(arg, begin, end) for every chunk
+ */
+void parallel_for(uint32_t n, uint32_t grain, range_fn fn, void *arg){
+	if(!grain) grain = 1;
+	uint32_t chunks = (n + grain - 1) / grain;
+	uint32_t threads = min(num_workers(), chunks);
+
+	if(threads <= 1 || in_parallel){
+		if(n) fn(arg, 0, n);
+		return;
+	}
+
+	range_job job = {n, grain, 0, fn, arg, ksh_ctx};
+	pthread_t tids[MAX_WORKERS];
+	uint32_t spawned = 0;
+	for(; spawned < threads-1; spawned++)
+		if(pthread_create(&tids[spawned], NULL, __range_worker, &job)) break;
+
+	__range_worker(&job);
+	for(uint32_t i=0; i<spawned; i++)
+		pthread_join(tids[i], NULL);
+}
@@ -13,8 +13,10 @@ void init_command(Command *command, string name){
     command->outfile = NULL;
     command->valid = true;
     command->append = false;
+    launch_init(&(command->launch));
     create_vector(&(command->argv), 2);
     command->name = check_bad_alloc(strdup(name));
+    command->builtin = builtin_id(name);
     push_back(&(command->argv), name);
 }
 
@@ -136,10 +138,24 @@ void parse_args(Command *command, string argstr){
         command->argc++;
         replace_tilda(&(command->argv.arr[command->argc]));
     }
-    if(!is_builtin(command->name))
+    if(command->builtin == -1)
         push_back(&(command->argv), NULL);
 }
 
+/**
+ * @brief Reads the launch attributes (@key=value tokens, see launch.h) in front of a command name
+ * @details Further tokens are read with strtok_r on saveptr, split on delim like the name is.
+ * 
+ * @param token First token of the command
+ * @return The command name, NULL if there is none or an attribute is bad
+ */
+char* __parse_launch(launch_attr *attr, char *token, char *delim, char **saveptr){
+    launch_init(attr);
+    for(; token && token[0]=='@'; token=strtok_r(NULL, delim, saveptr))
+        if(launch_parse(attr, token) == -1) return NULL;
+    return token;
+}
+
 /**
  * @brief If input contains a pipe, parse specially
  * @details Parses commands in the pipe one by one and populates a Pipe object
@@ -155,14 +171,16 @@ void parsePipe(string cmd){
     char *saveptr_p, *saveptr_c, *cmd_string;
     char *token = strtok_r(cmd, "|", &saveptr_p);
     Command *command;
+    launch_attr launch;
 
     // Separate pipe chain into individual commands
     for(;token!=NULL; token=strtok_r(NULL, "|", &saveptr_p)){
 
-        // The first space separated token will be the program name + handle errors
-        cmd_string = strtok_r(token, " ", &saveptr_c);
+        // The first space separated token will be the program name, after any launch attributes + handle errors
+        cmd_string = __parse_launch(&launch, strtok_r(token, " ", &saveptr_c), " ", &saveptr_c);
         if(!cmd_string){
             throw_error(BAD_PARSE);
+            KSH.status = -1;
             destroy_pipe(p);
             return;
         }
@@ -170,6 +188,7 @@ void parsePipe(string cmd){
         // Alloc mem for command and push to pipe list. destroy_pipe will handle freeing memory
         command = check_bad_alloc(malloc(sizeof(Command)));
         init_command(command, cmd_string);
+        command->launch = launch;
         cmd_string = strtok_r(NULL, "|", &saveptr_c);
 
         if(cmd_string)
@@ -187,7 +206,7 @@ void parsePipe(string cmd){
         ptr = ptr->next;
         pipe_len++;
     }
-    if(valid_pipe && pipe_len >= 2) exec_pipe(p);
+    KSH.status = (valid_pipe && pipe_len >= 2) ? exec_pipe(p) : -1;
 
     // Cleanup
     destroy_pipe(p);
@@ -196,7 +215,8 @@ void parsePipe(string cmd){
 /**
  * @brief Parses the entire line as read from the terminal
  * @details Separates commands by ;, &. Then initializes a Command struct
- * with all parsed data and then calls execute(Command)
+ * with all parsed data and then calls execute(Command). KSH.status is left
+ * with the status of the last one.
  *
  * @param linebuf The entire line read from the terminal
  */
@@ -224,6 +244,7 @@ void parse(string linebuf){
     // Read a single command, similar to the front of a queue
     char *front = strtok_r(cpystr, delim, &saveptr_p);
     Command command;
+    launch_attr launch;
 
     // Iterate and execute all commands in the queue
     for(;front!=NULL; front=strtok_r(NULL, delim, &saveptr_p)){
@@ -238,12 +259,18 @@ void parse(string linebuf){
             continue;
         }
         
-        // First arg is always the program name
+        // First arg is always the program name, after any launch attributes
         char *token = strtok_r(front, " \t", &saveptr_c);
         if(!token) continue;
+        if(!(token = __parse_launch(&launch, token, " \t", &saveptr_c))){
+            throw_error(BAD_PARSE);
+            KSH.status = -1;
+            continue;
+        }
 
         // Fill in the Command struct with parsed data
         init_command(&command, token);
+        command.launch = launch;
         token=strtok_r(NULL, delim, &saveptr_c);
         int delim_pos = (int)(saveptr_c-cpystr);
         command.runInBackground = (dupl[delim_pos]=='&');
@@ -254,9 +281,11 @@ void parse(string linebuf){
 
         // Output error if invalid command (parse error)
         if(command.valid)
-            execute(&command);
-        else
+            KSH.status = execute(&command);
+        else{
             throw_error(BAD_PARSE);
+            KSH.status = -1;
+        }
         // Execute and cleanup
         destroy_command(&command);
     }
@@ -0,0 +1,222 @@
+/**
+ * This is the code for loading builtin plugins (see ksh_plugin.h for the ABI).
+ * Plugin builtins are kept in a table next to the generated one of the core
+ * builtins: their ids follow the core ids, so a command resolved to one at
+ * parse time dispatches the same way. Libraries are unloaded once none of
+ * their builtins are enabled.
+ */
+
+#include "libs.h"
+#include "plugins.h"
+
+// -------------------------------- Shell services --------------------------------
+
+int __plugin_write(const char *data, size_t len){
+	return buf_write(&KSH.out, data, len);
+}
+
+int __plugin_printf(const char *format, ...){
+	va_list args;
+	va_start(args, format);
+	int ret = buf_vprintf(&KSH.out, format, args);
+	va_end(args);
+	return ret;
+}
+
+int __plugin_flush(){
+	return bflush();
+}
+
+int __plugin_cancelled(){
+	return KSH.plugins.cancelled;
+}
+
+const ksh_plugin_api plugin_api = {KSH_PLUGIN_ABI_VERSION, sizeof(ksh_plugin_api), __plugin_write,
+								   __plugin_printf, __plugin_flush, __plugin_cancelled};
+
+// -------------------------------- Table --------------------------------
+
+void create_plugins(plugin_table *t){
+	memset(t, 0, sizeof(plugin_table));
+}
+
+void __plugin_unload(plugin_table *t, plugin_lib *lib){
+	if(lib->info->fini) lib->info->fini();
+	dlclose(lib->handle);
+	for(uint32_t i=0; i<t->nlibs; i++)
+		if(t->libs[i] == lib) t->libs[i] = t->libs[--t->nlibs];
+	free(lib->path);
+	free(lib);
+}
+
+void destroy_plugins(plugin_table *t){
+	for(uint32_t i=0; i<t->size; i++)
+		free(t->builtins[i].name);
+	while(t->nlibs) __plugin_unload(t, t->libs[0]);
+	free(t->builtins);
+	free(t->libs);
+	memset(t, 0, sizeof(plugin_table));
+}
+
+/**
+ * @brief Looks up an enabled plugin builtin by name
+ * @return Its index in the table, -1 if there is none
+ */
+int plugin_find(plugin_table *t, const char *name){
+	for(uint32_t i=0; i<t->size; i++)
+		if(!strcmp(t->builtins[i].name, name)) return i;
+	return -1;
+}
+
+/**
+ * @brief Removes a builtin from the table, unloading its library if it was the last one enabled
+ */
+void __plugin_disable(plugin_table *t, int index){
+	plugin_lib *lib = t->builtins[index].lib;
+	free(t->builtins[index].name);
+	t->builtins[index] = t->builtins[--t->size];
+	if(!--lib->enabled) __plugin_unload(t, lib);
+}
+
+/**
+ * @brief Loads a plugin library, or returns it if it is already loaded
+ * @details The library must export KSH_PLUGIN_SYMBOL built against this ABI version,
+ * and its init hook (if any) must succeed.
+ *
+ * @return The library, NULL on failure (the reason is printed)
+ */
+plugin_lib* __plugin_load(plugin_table *t, const char *path){
+	void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if(!handle){
+		bprintf("enable: %s\n", dlerror());
+		return NULL;
+	}
+	for(uint32_t i=0; i<t->nlibs; i++)
+		if(t->libs[i]->handle == handle){
+			dlclose(handle);
+			return t->libs[i];
+		}
+
+	const ksh_plugin_info *info = dlsym(handle, KSH_PLUGIN_SYMBOL);
+	if(!info || !info->builtins){
+		bprintf("enable: %s does not export a %s symbol\n", path, KSH_PLUGIN_SYMBOL);
+		dlclose(handle);
+		return NULL;
+	}
+	if(info->abi_version != KSH_PLUGIN_ABI_VERSION){
+		bprintf("enable: %s was built for plugin ABI %u, this shell has %u\n", path, info->abi_version,
+				KSH_PLUGIN_ABI_VERSION);
+		dlclose(handle);
+		return NULL;
+	}
+	if(info->init && info->init(&plugin_api)){
+		bprintf("enable: %s failed to initialize\n", path);
+		dlclose(handle);
+		return NULL;
+	}
+
+	if(t->nlibs == t->libcap){
+		t->libcap = t->libcap ? t->libcap * 2 : 4;
+		t->libs = check_bad_alloc(realloc(t->libs, t->libcap * sizeof(plugin_lib*)));
+	}
+	plugin_lib *lib = check_bad_alloc(calloc(1, sizeof(plugin_lib)));
+	lib->handle = handle;
+	lib->path = check_bad_alloc(strdup(path));
+	lib->info = info;
+	t->libs[t->nlibs++] = lib;
+	return lib;
+}
+
+/**
+ * @brief Enables the builtin called name from a loaded library
+ * @return 0 on success, -1 on failure (the reason is printed)
+ */
+int __plugin_enable(plugin_table *t, plugin_lib *lib, const char *name){
+	if(builtin_id(name) != -1){
+		bprintf("enable: %s is already a builtin\n", name);
+		return -1;
+	}
+	const ksh_builtin_def *def = lib->info->builtins;
+	while(def->name && strcmp(def->name, name)) def++;
+	if(!def->name || !def->fn){
+		bprintf("enable: %s does not provide %s\n", lib->path, name);
+		return -1;
+	}
+
+	if(t->size == t->cap){
+		t->cap = t->cap ? t->cap * 2 : 8;
+		t->builtins = check_bad_alloc(realloc(t->builtins, t->cap * sizeof(plugin_builtin)));
+	}
+	t->builtins[t->size].name = check_bad_alloc(strdup(name));
+	t->builtins[t->size].def = def;
+	t->builtins[t->size++].lib = lib;
+	lib->enabled++;
+	return 0;
+}
+
+/**
+ * @brief Runs a plugin builtin in-process
+ * @details The builtin sees the shell's stdin / stdout / stderr, i.e. after redirection.
+ * Ctrl-c during the call only raises the cancelled flag (see ksh_ctrlc).
+ *
+ * @param index Its index in the table, the command's builtin id minus the core builtin count
+ * @return The builtin's status, -1 if it was disabled in the meantime
+ */
+int plugin_call(plugin_table *t, int index, Command *c){
+	if(index < 0 || (uint32_t) index >= t->size) return -1;
+
+	// argv is handed over as is, but must end with NULL
+	if(c->argv.size == (size_t) c->argc + 1) push_back(&(c->argv), NULL);
+	ksh_plugin_call call = {c->argc + 1, c->argv.arr, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+
+	t->cancelled = 0;
+	t->running = 1;
+	int ret = t->builtins[index].def->fn(&call, &plugin_api);
+	t->running = 0;
+	return ret;
+}
+
+/**
+ * @brief Loads, lists and disables plugin builtins
+ * @details Usage: `enable -f lib.so name...` loads a plugin and enables the listed
+ * builtins from it. `enable -n name...` disables them again. Without arguments lists
+ * the enabled plugin builtins.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int enable(Command *c){
+	plugin_table *t = &KSH.plugins;
+	if(!c->argc){
+		for(uint32_t i=0; i<t->size; i++){
+			plugin_builtin *b = &t->builtins[i];
+			bprintf("%-16s %-32s %s\n", b->name, b->lib->path, b->def->help ? b->def->help : "");
+		}
+		return 0;
+	}
+
+	int ret = 0;
+	if(!strcmp(c->argv.arr[1], "-f")){
+		if(c->argc < 3){
+			throw_error(TOO_LESS_ARGS); return -1;
+		}
+		plugin_lib *lib = __plugin_load(t, c->argv.arr[2]);
+		if(!lib) return -1;
+		for(int i=3; i<=c->argc; i++)
+			if(__plugin_enable(t, lib, c->argv.arr[i]) == -1) ret = -1;
+		if(!lib->enabled) __plugin_unload(t, lib);
+	}
+	else if(!strcmp(c->argv.arr[1], "-n")){
+		for(int i=2; i<=c->argc; i++){
+			int index = plugin_find(t, c->argv.arr[i]);
+			if(index == -1){
+				bprintf("enable: %s is not a plugin builtin\n", c->argv.arr[i]);
+				ret = -1;
+			}
+			else __plugin_disable(t, index);
+		}
+	}
+	else{
+		throw_error(BAD_ARGS); return -1;
+	}
+	return ret;
+}
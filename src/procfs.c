@@ -0,0 +1,562 @@
+/**
+ * This is the code for reading /proc. Files are parsed into typed structs
+ * straight from stack buffers (or from the buffer of a proc_source that
+ * is kept open and re-read). Callers pass a mask of the fields they need:
+ * only those are filled, and parsing stops as soon as all of them are found.
+ */
+
+#include "libs.h"
+#include "procfs.h"
+
+#define KEY_NUM 0
+#define KEY_NUM2 1
+#define KEY_STR 2
+#define KEY_CHAR 3
+
+/**
+ * Maps a `Key:` line of a keyed file (status, io, meminfo) to a field
+ */
+typedef struct procfs_key{
+	const char *key;
+	uint32_t bit;
+	int type;
+	size_t offset;
+} procfs_key;
+
+typedef struct key_scan{
+	const procfs_key *keys;
+	uint32_t mask;
+	uint32_t left;
+	void *out;
+} key_scan;
+
+typedef struct irq_scan{
+	const char *irq;
+	size_t len;
+	int64_t *count;
+	bool found;
+} irq_scan;
+
+typedef bool (*line_fn)(char *line, void *arg);
+
+const procfs_key status_keys[] = {
+	{"Name", PST_NAME, KEY_STR, offsetof(proc_status, name)},
+	{"State", PST_STATE, KEY_CHAR, offsetof(proc_status, state)},
+	{"Tgid", PST_TGID, KEY_NUM, offsetof(proc_status, tgid)},
+	{"PPid", PST_PPID, KEY_NUM, offsetof(proc_status, ppid)},
+	{"Uid", PST_UID, KEY_NUM2, offsetof(proc_status, uid)},
+	{"VmSize", PST_VMSIZE, KEY_NUM, offsetof(proc_status, vm_size)},
+	{"VmRSS", PST_VMRSS, KEY_NUM, offsetof(proc_status, vm_rss)},
+	{"Threads", PST_THREADS, KEY_NUM, offsetof(proc_status, threads)},
+	{"voluntary_ctxt_switches", PST_CTXT, KEY_NUM, offsetof(proc_status, voluntary_ctxt)},
+	{"nonvoluntary_ctxt_switches", PST_CTXT, KEY_NUM, offsetof(proc_status, nonvoluntary_ctxt)},
+	{NULL, 0, 0, 0}
+};
+
+const procfs_key io_keys[] = {
+	{"rchar", PIO_RCHAR, KEY_NUM, offsetof(proc_io, rchar)},
+	{"wchar", PIO_WCHAR, KEY_NUM, offsetof(proc_io, wchar)},
+	{"syscr", PIO_SYSCR, KEY_NUM, offsetof(proc_io, syscr)},
+	{"syscw", PIO_SYSCW, KEY_NUM, offsetof(proc_io, syscw)},
+	{"read_bytes", PIO_READ_BYTES, KEY_NUM, offsetof(proc_io, read_bytes)},
+	{"write_bytes", PIO_WRITE_BYTES, KEY_NUM, offsetof(proc_io, write_bytes)},
+	{"cancelled_write_bytes", PIO_CANCELLED, KEY_NUM, offsetof(proc_io, cancelled_write_bytes)},
+	{NULL, 0, 0, 0}
+};
+
+const procfs_key meminfo_keys[] = {
+	{"MemTotal", PM_TOTAL, KEY_NUM, offsetof(proc_meminfo, total)},
+	{"MemFree", PM_FREE, KEY_NUM, offsetof(proc_meminfo, free)},
+	{"MemAvailable", PM_AVAILABLE, KEY_NUM, offsetof(proc_meminfo, available)},
+	{"Buffers", PM_BUFFERS, KEY_NUM, offsetof(proc_meminfo, buffers)},
+	{"Cached", PM_CACHED, KEY_NUM, offsetof(proc_meminfo, cached)},
+	{"Dirty", PM_DIRTY, KEY_NUM, offsetof(proc_meminfo, dirty)},
+	{"Writeback", PM_WRITEBACK, KEY_NUM, offsetof(proc_meminfo, writeback)},
+	{"SwapTotal", PM_SWAP_TOTAL, KEY_NUM, offsetof(proc_meminfo, swap_total)},
+	{"SwapFree", PM_SWAP_FREE, KEY_NUM, offsetof(proc_meminfo, swap_free)},
+	{NULL, 0, 0, 0}
+};
+
+// -------------------------------- /proc sources --------------------------------
+
+/**
+ * @brief Opens a /proc file for repeated sampling
+ * @return 0 on success, -1 on failure
+ */
+int proc_open(proc_source *s, const char *path){
+	s->cap = PROCFS_BUF_SIZE;
+	s->buf = check_bad_alloc(malloc(s->cap));
+	s->buf[0] = 0;
+	s->fd = open(path, O_RDONLY | O_CLOEXEC);
+	return (s->fd == -1) ? -1 : 0;
+}
+
+void proc_close(proc_source *s){
+	if(s->fd != -1) close(s->fd);
+	free(s->buf);
+	s->fd = -1;
+	s->buf = NULL;
+}
+
+/**
+ * @brief Reads the whole file from offset 0. The contents are NUL terminated.
+ * @details /proc files are generated on read, so a read that fills the buffer may
+ * have been truncated. The buffer is doubled and the file read again.
+ *
+ * @return Number of bytes read. -1 on failure.
+ */
+ssize_t proc_read(proc_source *s){
+	while(1){
+		ssize_t len = 0, ret;
+		while((ret = pread(s->fd, s->buf + len, s->cap - 1 - len, len)) > 0)
+			len += ret;
+		if(ret == -1){
+			s->buf[0] = 0;
+			return -1;
+		}
+		if(len < s->cap - 1){
+			s->buf[len] = 0;
+			return len;
+		}
+		s->cap <<= 1;
+		s->buf = check_bad_alloc(realloc(s->buf, s->cap));
+	}
+}
+
+/**
+ * @brief Returns the line of buf starting with key (ignoring leading blanks), NULL if none
+ */
+char* proc_find_line(char *buf, const char *key){
+	size_t n = strlen(key);
+	char *line = buf;
+	while(line && *line){
+		char *ptr = line;
+		while(*ptr == ' ') ptr++;
+		if(!strncmp(ptr, key, n)) return line;
+		line = strchr(line, '\n');
+		if(line) line++;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Opens /proc/pid/file, or /proc/file for system wide files if pid <= 0
+ * @return The fd, -1 on failure
+ */
+int procfs_open(pid_t pid, const char *file){
+	char path[64];
+	if(pid > 0) snprintf(path, sizeof(path), "/proc/%d/%s", pid, file);
+	else snprintf(path, sizeof(path), "/proc/%s", file);
+	return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+// -------------------------------- Util functions --------------------------------
+
+/**
+ * @brief Parses the next (possibly negative) number at *ptr, skipping blanks. Advances *ptr.
+ * @details Never reads past the end of the line. Returns 0 if there is no number.
+ */
+int64_t __procfs_num(char **ptr){
+	char *p = *ptr;
+	while(*p == ' ' || *p == '\t') p++;
+	bool neg = (*p == '-');
+	if(neg) p++;
+	int64_t num = 0;
+	for(; *p >= '0' && *p <= '9'; p++)
+		num = num*10 + (*p - '0');
+	*ptr = p;
+	return (neg) ? -num : num;
+}
+
+/**
+ * @brief Calls fn on every line of a NUL terminated buffer until it returns false
+ * @details Lines are not terminated in place, callbacks stop at '\n' themselves.
+ */
+void __procfs_lines(char *buf, line_fn fn, void *arg){
+	for(char *line = buf; line && *line;){
+		if(!fn(line, arg)) return;
+		line = strchr(line, '\n');
+		if(line) line++;
+	}
+}
+
+/**
+ * @brief Calls fn on every line of the file behind fd until it returns false
+ * @details Reads the file in stack sized chunks from offset 0, so files of any size
+ * are parsed without allocating. Lines longer than a chunk are cut short.
+ *
+ * @return 0 on success, -1 on a failed read
+ */
+int __procfs_scan(int fd, line_fn fn, void *arg){
+	char buf[PROCFS_BUF_SIZE];
+	size_t keep = 0;
+	off_t off = 0;
+	bool skip = false;
+	while(1){
+		ssize_t len = pread(fd, buf + keep, sizeof(buf) - 1 - keep, off);
+		if(len < 0) return -1;
+		off += len;
+		size_t end = keep + len;
+		buf[end] = 0;
+
+		char *line = buf, *nl;
+		while((nl = strchr(line, '\n'))){
+			// Tail of a line that didn't fit in the buffer
+			if(skip) skip = false;
+			else if(!fn(line, arg)) return 0;
+			line = nl + 1;
+		}
+		keep = buf + end - line;
+		if(!len){
+			if(keep && !skip) fn(line, arg);
+			return 0;
+		}
+		if(keep == sizeof(buf) - 1){
+			if(!skip && !fn(line, arg)) return 0;
+			skip = true;
+			keep = 0;
+		}
+		memmove(buf, line, keep);
+	}
+}
+
+/**
+ * @brief Line callback for keyed files. Fills the field of the line if it was asked for.
+ * @return false once every requested field was found
+ */
+bool __procfs_key_line(char *line, void *arg){
+	key_scan *k = arg;
+	char *colon = line;
+	while(*colon && *colon != ':' && *colon != '\n') colon++;
+	if(*colon != ':') return true;
+	size_t n = colon - line;
+
+	for(const procfs_key *key = k->keys; key->key; key++){
+		if(!(k->mask & key->bit) || key->key[0] != line[0] || strncmp(key->key, line, n) || key->key[n]) continue;
+		char *ptr = colon + 1, *field = (char*) k->out + key->offset;
+		if(key->type == KEY_STR){
+			while(*ptr == ' ' || *ptr == '\t') ptr++;
+			size_t len = min(strcspn(ptr, "\n"), PROC_COMM_MAX - 1);
+			memcpy(field, ptr, len);
+			field[len] = 0;
+		}
+		else if(key->type == KEY_CHAR){
+			while(*ptr == ' ' || *ptr == '\t') ptr++;
+			*field = *ptr;
+		}
+		else{
+			((int64_t*) field)[0] = __procfs_num(&ptr);
+			if(key->type == KEY_NUM2) ((int64_t*) field)[1] = __procfs_num(&ptr);
+		}
+		k->left--;
+		break;
+	}
+	return k->left > 0;
+}
+
+/**
+ * @brief Sets up a scan for the fields of mask. The requested fields are zeroed.
+ */
+void __procfs_keys(key_scan *k, const procfs_key *keys, uint32_t mask, void *out, size_t size){
+	memset(out, 0, size);
+	k->keys = keys;
+	k->mask = mask;
+	k->out = out;
+	k->left = 0;
+	for(const procfs_key *key = keys; key->key; key++)
+		if(mask & key->bit) k->left++;
+}
+
+/**
+ * @brief Line callback for /proc/interrupts. Sums the per CPU counts of one IRQ.
+ */
+bool __procfs_irq_line(char *line, void *arg){
+	irq_scan *s = arg;
+	while(*line == ' ') line++;
+	if(strncmp(line, s->irq, s->len) || line[s->len] != ':') return true;
+
+	char *ptr = line + s->len + 1;
+	*s->count = 0;
+	while(1){
+		while(*ptr == ' ') ptr++;
+		if(*ptr < '0' || *ptr > '9') break;
+		*s->count += __procfs_num(&ptr);
+	}
+	s->found = true;
+	return false;
+}
+
+// -------------------------------- Parsers --------------------------------
+
+/**
+ * @brief Parses /proc/pid/stat
+ * @details comm is whatever is between the first '(' and the last ')', so names
+ * with spaces or parentheses don't shift the fields after it. Parsing stops after
+ * the last requested field.
+ *
+ * @return 0 on success, -1 if buf isn't a stat line
+ */
+int procfs_parse_stat(char *buf, proc_stat *st, uint32_t mask){
+	char *open = strchr(buf, '('), *close = strrchr(buf, ')');
+	if(!open || !close || close < open || close[1] != ' ') return -1;
+
+	char *ptr = buf;
+	st->pid = __procfs_num(&ptr);
+	if(mask & PS_COMM){
+		size_t len = min(close - open - 1, PROC_COMM_MAX - 1);
+		memcpy(st->comm, open + 1, len);
+		st->comm[len] = 0;
+	}
+	ptr = close + 2;
+	st->state = *ptr++;
+
+	// Last field number each flag needs, the state is field 3
+	int last = 3;
+	if(mask & PS_RSS) last = 24;
+	else if(mask & PS_VSIZE) last = 23;
+	else if(mask & PS_START) last = 22;
+	else if(mask & PS_THREADS) last = 20;
+	else if(mask & PS_PRIO) last = 19;
+	else if(mask & PS_TIMES) last = 15;
+	else if(mask & PS_TPGID) last = 8;
+	else if(mask & PS_TTY) last = 7;
+	else if(mask & PS_SESSION) last = 6;
+	else if(mask & PS_PGRP) last = 5;
+	else if(mask & PS_PPID) last = 4;
+
+	for(int field=4; field<=last; field++){
+		int64_t val = __procfs_num(&ptr);
+		switch(field){
+			case 4: st->ppid = val; break;
+			case 5: st->pgrp = val; break;
+			case 6: st->session = val; break;
+			case 7: st->tty_nr = val; break;
+			case 8: st->tpgid = val; break;
+			case 14: st->utime = val; break;
+			case 15: st->stime = val; break;
+			case 18: st->priority = val; break;
+			case 19: st->nice = val; break;
+			case 20: st->num_threads = val; break;
+			case 22: st->starttime = val; break;
+			case 23: st->vsize = val; break;
+			case 24: st->rss = val; break;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Parses the requested fields of /proc/pid/status
+ * @return 0 if all of them were found, -1 otherwise
+ */
+int procfs_parse_status(char *buf, proc_status *st, uint32_t mask){
+	key_scan k;
+	__procfs_keys(&k, status_keys, mask, st, sizeof(proc_status));
+	__procfs_lines(buf, __procfs_key_line, &k);
+	return (k.left) ? -1 : 0;
+}
+
+/**
+ * @brief Parses the requested fields of /proc/pid/io
+ * @return 0 if all of them were found, -1 otherwise
+ */
+int procfs_parse_io(char *buf, proc_io *io, uint32_t mask){
+	key_scan k;
+	__procfs_keys(&k, io_keys, mask, io, sizeof(proc_io));
+	__procfs_lines(buf, __procfs_key_line, &k);
+	return (k.left) ? -1 : 0;
+}
+
+/**
+ * @brief Parses the requested fields of /proc/meminfo
+ * @return 0 if all of them were found, -1 otherwise
+ */
+int procfs_parse_meminfo(char *buf, proc_meminfo *m, uint32_t mask){
+	key_scan k;
+	__procfs_keys(&k, meminfo_keys, mask, m, sizeof(proc_meminfo));
+	__procfs_lines(buf, __procfs_key_line, &k);
+	return (k.left) ? -1 : 0;
+}
+
+/**
+ * @brief Parses /proc/loadavg
+ * @return 0 on success, -1 if buf isn't a loadavg line
+ */
+int procfs_parse_loadavg(char *buf, proc_loadavg *l){
+	char *ptr = buf;
+	for(int i=0; i<3; i++){
+		l->load[i] = __procfs_num(&ptr) * 100;
+		if(*ptr == '.'){
+			ptr++;
+			if(isdigit(ptr[0])) l->load[i] += (ptr[0] - '0') * 10;
+			if(isdigit(ptr[0]) && isdigit(ptr[1])) l->load[i] += ptr[1] - '0';
+			while(isdigit(*ptr)) ptr++;
+		}
+	}
+	l->running = __procfs_num(&ptr);
+	if(*ptr != '/') return -1;
+	ptr++;
+	l->total = __procfs_num(&ptr);
+	l->last_pid = __procfs_num(&ptr);
+	return 0;
+}
+
+/**
+ * @brief Sums the per CPU counts of one line of /proc/interrupts
+ *
+ * @param irq Name of the line without the colon. Ex: "1", "NMI"
+ * @return 0 on success, -1 if the IRQ isn't listed
+ */
+int procfs_parse_irq(char *buf, const char *irq, int64_t *count){
+	irq_scan s = {irq, strlen(irq), count, false};
+	*count = 0;
+	__procfs_lines(buf, __procfs_irq_line, &s);
+	return (s.found) ? 0 : -1;
+}
+
+// -------------------------------- Readers --------------------------------
+
+/**
+ * @brief Reads and parses /proc/pid/stat from an open fd
+ * @return 0 on success, -1 on failure
+ */
+int procfs_read_stat(int fd, proc_stat *st, uint32_t mask){
+	char buf[PROCFS_STAT_SIZE];
+	ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if(len <= 0) return -1;
+	buf[len] = 0;
+	return procfs_parse_stat(buf, st, mask);
+}
+
+/**
+ * @brief Reads the requested fields of /proc/pid/status from an open fd
+ * @return 0 on success, -1 on failure or if a field is missing
+ */
+int procfs_read_status(int fd, proc_status *st, uint32_t mask){
+	key_scan k;
+	__procfs_keys(&k, status_keys, mask, st, sizeof(proc_status));
+	if(__procfs_scan(fd, __procfs_key_line, &k) == -1) return -1;
+	return (k.left) ? -1 : 0;
+}
+
+/**
+ * @brief Reads the requested fields of /proc/pid/io from an open fd
+ * @return 0 on success, -1 on failure (ex: not our process) or if a field is missing
+ */
+int procfs_read_io(int fd, proc_io *io, uint32_t mask){
+	key_scan k;
+	__procfs_keys(&k, io_keys, mask, io, sizeof(proc_io));
+	if(__procfs_scan(fd, __procfs_key_line, &k) == -1) return -1;
+	return (k.left) ? -1 : 0;
+}
+
+/**
+ * @brief Reads the requested fields of /proc/meminfo from an open fd
+ * @return 0 on success, -1 on failure or if a field is missing
+ */
+int procfs_read_meminfo(int fd, proc_meminfo *m, uint32_t mask){
+	key_scan k;
+	__procfs_keys(&k, meminfo_keys, mask, m, sizeof(proc_meminfo));
+	if(__procfs_scan(fd, __procfs_key_line, &k) == -1) return -1;
+	return (k.left) ? -1 : 0;
+}
+
+/**
+ * @brief Reads and parses /proc/loadavg from an open fd
+ * @return 0 on success, -1 on failure
+ */
+int procfs_read_loadavg(int fd, proc_loadavg *l){
+	char buf[256];
+	ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if(len <= 0) return -1;
+	buf[len] = 0;
+	return procfs_parse_loadavg(buf, l);
+}
+
+/**
+ * @brief Reads the count of one IRQ from an open /proc/interrupts fd
+ * @return 0 on success, -1 on failure or if the IRQ isn't listed
+ */
+int procfs_read_irq(int fd, const char *irq, int64_t *count){
+	irq_scan s = {irq, strlen(irq), count, false};
+	*count = 0;
+	if(__procfs_scan(fd, __procfs_irq_line, &s) == -1) return -1;
+	return (s.found) ? 0 : -1;
+}
+
+// -------------------------------- Benchmark --------------------------------
+
+typedef struct bench_file{
+	const char *name;
+	pid_t pid;
+	const char *file;
+} bench_file;
+
+/**
+ * @brief Runs one parser n times on an open fd and on a buffer read once.
+ * @details Returns the mean time of a read + parse and of a parse alone, in ns.
+ */
+void __procbench_one(int id, int fd, uint32_t n, int64_t *read_ns, int64_t *parse_ns, ssize_t *size){
+	proc_stat st;
+	proc_status status;
+	proc_io io;
+	proc_meminfo m;
+	proc_loadavg l;
+	int64_t count;
+	proc_source src = {fd, check_bad_alloc(malloc(PROCFS_BUF_SIZE)), PROCFS_BUF_SIZE};
+	*size = proc_read(&src);
+
+	for(int pass=0; pass<2; pass++){
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for(uint32_t i=0; i<n; i++){
+			switch(id){
+				case 0: (pass) ? procfs_parse_stat(src.buf, &st, ~0u) : procfs_read_stat(fd, &st, ~0u); break;
+				case 1: (pass) ? procfs_parse_status(src.buf, &status, ~0u) : procfs_read_status(fd, &status, ~0u); break;
+				case 2: (pass) ? procfs_parse_io(src.buf, &io, ~0u) : procfs_read_io(fd, &io, ~0u); break;
+				case 3: (pass) ? procfs_parse_meminfo(src.buf, &m, ~0u) : procfs_read_meminfo(fd, &m, ~0u); break;
+				case 4: (pass) ? procfs_parse_loadavg(src.buf, &l) : procfs_read_loadavg(fd, &l); break;
+				case 5: (pass) ? procfs_parse_irq(src.buf, "NMI", &count) : procfs_read_irq(fd, "NMI", &count); break;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		int64_t ns = (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+		*((pass) ? parse_ns : read_ns) = ns / n;
+	}
+	proc_close(&src);
+}
+
+/**
+ * @brief Benchmarks the procfs parsers
+ * @details Usage: `procbench [n]`. Reads and parses each supported file n times
+ * (1000 by default) and prints the mean cost per file, with and without the read.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int procbench(Command *c){
+	if(c->argc > 1){
+		throw_error(TOO_MANY_ARGS);
+		return -1;
+	}
+	int64_t n = (c->argc) ? string_to_int(c->argv.arr[1]) : 1000;
+	if(n <= 0){
+		throw_error(BAD_ARGS);
+		return -1;
+	}
+
+	bench_file files[] = {{"stat", getpid(), "stat"}, {"status", getpid(), "status"}, {"io", getpid(), "io"},
+						  {"meminfo", 0, "meminfo"}, {"loadavg", 0, "loadavg"}, {"interrupts", 0, "interrupts"}};
+	bprintf("%-12s %8s %14s %10s\n", "file", "bytes", "read+parse ns", "parse ns");
+	for(int i=0; i<6; i++){
+		int fd = procfs_open(files[i].pid, files[i].file);
+		if(fd == -1){
+			bprintf("%-12s %s\n", files[i].name, strerror(errno));
+			continue;
+		}
+		int64_t read_ns, parse_ns;
+		ssize_t size;
+		__procbench_one(i, fd, n, &read_ns, &parse_ns, &size);
+		bprintf("%-12s %8ld %14ld %10ld\n", files[i].name, size, read_ns, parse_ns);
+	}
+	return 0;
+}
@@ -14,6 +14,10 @@ void insert_process(pid_t id, string s, struct Process **head){
 	ll->job_num = ++KSH.jobs_spawned;
 	ll->str = malloc(strlen(s)+1);
 	strcpy(ll->str, s);
+	ll->stat_fd = ll->io_fd = -1;
+	ll->cpu_ticks = 0;
+	ll->sampled_ns = 0;
+	launch_init(&ll->launch);
 	ll->next = *head;
 	ll->prev = NULL;
 	if(*head)
@@ -44,6 +48,7 @@ int remove_process(pid_t id, struct Process **head){
 			else{
 				*head = cur->next;
 			}
+			jobmon_close(cur);
 			free(cur);
 			return 0;
 		}
@@ -132,6 +137,7 @@ void destroy_proclist(ProcList *ll){
 	Process *cur = head;
 	while(cur!=NULL){
 		cur = cur->next;
+		jobmon_close(head);
 		free(head);
 		head = cur;
 	}
@@ -26,6 +26,26 @@ void enableRawMode() {
     if (tcsetattr(0, TCSAFLUSH, &raw) == -1) throw_fatal_perror("tcsetattr");
 }
 
+/**
+ * @brief Reads one character of input
+ * @details Waits on stdin and the timer wheel's timerfd together, timers that come
+ * due while the shell waits for input are run in between keys.
+ * 
+ * @return 1 if a character was read, as read(2) otherwise
+ */
+ssize_t __read_key(char *c){
+    struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {KSH.timers.tfd, POLLIN, 0}};
+    nfds_t n = (KSH.timers.tfd != -1) ? 2 : 1;
+    while(true){
+        if(poll(fds, n, -1) == -1){
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        if(n == 2 && (fds[1].revents & POLLIN)) timers_run(&KSH.timers);
+        if(fds[0].revents) return read(STDIN_FILENO, c, 1);
+    }
+}
+
 // TODO: Make this look nicer :)
 string get_line(){
     getline_inp = check_bad_alloc(malloc(sizeof(char) * MAX_COMMAND_LENGTH));
@@ -36,7 +56,7 @@ string get_line(){
     memset(getline_inp, 0, MAX_COMMAND_LENGTH);
     getline_pt = 0;
     int history_on = -1;
-    while (read(0, &c, 1) == 1) {
+    while (__read_key(&c) == 1) {
         if(getline_pt==MAX_COMMAND_LENGTH){
             getline_inp = realloc(getline_inp, getline_pt<<1);
             retval = getline_inp;
@@ -129,6 +149,7 @@ int prompt(){
     cprintf(FG_BLUE, 0, "<%s@%s:", KSH.username, KSH.hostname);
     cprintf(FG_YELLOW, 0, "%s", KSH.promptdir);
     cprintf(FG_BLUE, 0, "> ");
+    bflush();
 
     // Read user command
     string linebuf = get_line();
@@ -0,0 +1,315 @@
+#include "libs.h"
+#include "ptop.h"
+
+#define PTOP_STAT_MASK (PS_COMM | PS_STATE | PS_PGRP | PS_TIMES | PS_THREADS | PS_START | PS_VSIZE | PS_RSS)
+
+// -------------------------------- Pid table --------------------------------
+
+uint32_t __ptop_hash(pid_t pid, uint32_t mask){
+	return ((uint32_t) pid * 2654435761u) & mask;
+}
+
+/**
+ * @brief Finds the slot of pid, or the empty slot where it would go
+ */
+uint32_t __ptop_find(ptop_table *t, pid_t pid){
+	uint32_t mask = t->cap - 1, i = __ptop_hash(pid, mask);
+	while(t->slots[i].pid && t->slots[i].pid != pid) i = (i + 1) & mask;
+	return i;
+}
+
+void __ptop_grow(ptop_table *t){
+	ptop_entry *old = t->slots;
+	uint32_t oldcap = t->cap;
+	t->cap = oldcap ? oldcap * 2 : PTOP_MIN_SLOTS;
+	t->slots = check_bad_alloc(calloc(t->cap, sizeof(ptop_entry)));
+	for(uint32_t i=0; i<oldcap; i++)
+		if(old[i].pid) t->slots[__ptop_find(t, old[i].pid)] = old[i];
+	free(old);
+}
+
+/**
+ * @brief Returns the entry of pid, inserting a fresh one (fd -1, never seen) if missing
+ */
+ptop_entry* __ptop_insert(ptop_table *t, pid_t pid){
+	if((t->size + 1) * 2 > t->cap) __ptop_grow(t);
+	ptop_entry *e = &t->slots[__ptop_find(t, pid)];
+	if(!e->pid){
+		memset(e, 0, sizeof(ptop_entry));
+		e->pid = pid;
+		e->fd = -1;
+		t->size++;
+	}
+	return e;
+}
+
+/**
+ * @brief Empties slot i, shifting back the entries after it whose probe
+ * sequence passes through it
+ */
+void __ptop_remove(ptop_table *t, uint32_t i){
+	uint32_t mask = t->cap - 1;
+	for(uint32_t j = (i + 1) & mask; t->slots[j].pid; j = (j + 1) & mask){
+		uint32_t home = __ptop_hash(t->slots[j].pid, mask);
+		if(((j - home) & mask) >= ((j - i) & mask)){
+			t->slots[i] = t->slots[j];
+			i = j;
+		}
+	}
+	t->slots[i].pid = 0;
+	t->size--;
+}
+
+void __ptop_close_fd(ptop_table *t, ptop_entry *e){
+	if(e->fd == -1) return;
+	close(e->fd);
+	e->fd = -1;
+	t->nfds--;
+}
+
+/**
+ * @brief Raises the fd soft limit for the duration of ptop and sizes the fd cache to it
+ * @param old Set to the limit to restore once done
+ * @return 0 on success, -1 if the limit couldn't be read. No fds are cached then.
+ */
+int __ptop_fd_budget(ptop_table *t, struct rlimit *old){
+	struct rlimit rl;
+	t->max_fds = 0;
+	if(getrlimit(RLIMIT_NOFILE, old) == -1) return -1;
+	rl = *old;
+	rlim_t want = PTOP_MAX_CACHED_FDS + PTOP_FD_RESERVE;
+	if(rl.rlim_cur < want){
+		rl.rlim_cur = (rl.rlim_max < want) ? rl.rlim_max : want;
+		if(setrlimit(RLIMIT_NOFILE, &rl) == -1) rl = *old;
+	}
+	if(rl.rlim_cur > PTOP_FD_RESERVE)
+		t->max_fds = (rl.rlim_cur - PTOP_FD_RESERVE < want) ? rl.rlim_cur - PTOP_FD_RESERVE : PTOP_MAX_CACHED_FDS;
+	return 0;
+}
+
+void __ptop_destroy(ptop_table *t){
+	for(uint32_t i=0; i<t->cap; i++)
+		if(t->slots[i].pid) __ptop_close_fd(t, &t->slots[i]);
+	free(t->slots);
+	if(t->procfd != -1) close(t->procfd);
+	if(t->loadfd != -1) close(t->loadfd);
+}
+
+// -------------------------------- Sampling --------------------------------
+
+/**
+ * @brief Samples one pid found in the scan
+ * @details The cached stat fd is read when there is one. An fd whose process
+ * exited reads ESRCH even if the pid got reused, so a failed read falls back
+ * to a fresh open. A changed start time means a new process under the old
+ * pid, its CPU is then averaged over its lifetime like on a first sample.
+ *
+ * @return 0 on success, -1 if the process is gone
+ */
+int __ptop_sample(ptop_table *t, const char *name, pid_t pid, int64_t now_ns, int64_t hz){
+	ptop_entry *e = __ptop_insert(t, pid);
+	proc_stat st;
+	int ret = -1;
+	if(e->fd != -1 && (ret = procfs_read_stat(e->fd, &st, PTOP_STAT_MASK)) == -1)
+		__ptop_close_fd(t, e);
+
+	if(ret == -1){
+		char path[NAME_MAX + 8];
+		snprintf(path, sizeof(path), "%s/stat", name);
+		int fd = openat(t->procfd, path, O_RDONLY | O_CLOEXEC);
+		if(fd == -1) return -1;
+		ret = procfs_read_stat(fd, &st, PTOP_STAT_MASK);
+		if(ret == -1 || t->nfds >= t->max_fds) close(fd);
+		else{
+			e->fd = fd;
+			t->nfds++;
+		}
+		if(ret == -1) return -1;
+	}
+
+	uint64_t ticks = st.utime + st.stime;
+	if(e->seen && e->starttime == st.starttime && now_ns > t->last_ns)
+		e->cpu = (int64_t) (ticks - e->ticks) * 1000 * 1000000000LL / ((now_ns - t->last_ns) * hz);
+	else{
+		int64_t alive = now_ns / (1000000000LL / hz) - (int64_t) st.starttime;
+		e->cpu = (alive > 0) ? (int64_t) ticks * 1000 / alive : 0;
+	}
+	e->ticks = ticks;
+	e->starttime = st.starttime;
+	e->st = st;
+	e->seen = t->gen;
+	return 0;
+}
+
+/**
+ * @brief One refresh: samples every pid in /proc, then evicts the pids that are gone
+ * @details /proc is kept open and rewound, its entries are read in large
+ * getdents64 batches without stat-ing them.
+ */
+void __ptop_refresh(ptop_table *t, char *buf){
+	static int64_t hz = 0;
+	if(!hz) hz = sysconf(_SC_CLK_TCK);
+
+	struct timespec ts;
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	int64_t now_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	t->gen++;
+
+	long nread;
+	lseek(t->procfd, 0, SEEK_SET);
+	while((nread = syscall(SYS_getdents64, t->procfd, buf, PTOP_DENTS_BUF)) > 0){
+		for(long pos = 0; pos < nread;){
+			struct linux_dirent64 *dent = (struct linux_dirent64*) (buf + pos);
+			pos += dent->d_reclen;
+			if(dent->d_type != DT_DIR || !isdigit(dent->d_name[0])) continue;
+			__ptop_sample(t, dent->d_name, (pid_t) strtol(dent->d_name, NULL, 10), now_ns, hz);
+		}
+	}
+
+	for(uint32_t i=0; i<t->cap;){
+		ptop_entry *e = &t->slots[i];
+		if(e->pid && e->seen != t->gen){
+			__ptop_close_fd(t, e);
+			__ptop_remove(t, i);
+			continue;
+		}
+		i++;
+	}
+	t->last_ns = now_ns;
+}
+
+// -------------------------------- Display --------------------------------
+
+/**
+ * @brief Number of process rows that fit in the terminal, 20 if it isn't one
+ */
+uint32_t __ptop_rows(){
+	struct winsize ws;
+	if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_row <= 4) return 20;
+	return ws.ws_row - 4;
+}
+
+/**
+ * @brief Redraws the table, sorted by CPU or resident memory
+ * @details The status column is formatted as in pinfo: the state followed by
+ * `+` for processes in the foreground process group, `-` otherwise.
+ */
+void __ptop_print(ptop_table *t, int sort, struct timespec *interval){
+	uint32_t n = 0, running = 0, alloc = t->size ? t->size : 1;
+	ptop_entry **live = check_bad_alloc(malloc(alloc * sizeof(ptop_entry*)));
+	int64_t *keys = check_bad_alloc(malloc(alloc * sizeof(int64_t)));
+	string *names = check_bad_alloc(malloc(alloc * sizeof(string)));
+	for(uint32_t i=0; i<t->cap; i++){
+		ptop_entry *e = &t->slots[i];
+		if(!e->pid) continue;
+		live[n] = e;
+		keys[n] = (sort == PTOP_SORT_CPU) ? e->cpu : e->st.rss;
+		names[n++] = e->st.comm;
+		running += (e->st.state == 'R');
+	}
+	uint32_t *perm = sort_by_key(names, keys, n);
+	apply_permutation(live, sizeof(ptop_entry*), perm, n);
+
+	proc_loadavg l = {0};
+	if(t->loadfd != -1) procfs_read_loadavg(t->loadfd, &l);
+	bprintf("\033[H\033[2Jptop - %u processes, %u running, load %ld.%02ld %ld.%02ld %ld.%02ld, by %s every %ld.%03lds "
+			"(c/m to sort, q to quit)\n\n", n, running, l.load[0] / 100, l.load[0] % 100, l.load[1] / 100,
+			l.load[1] % 100, l.load[2] / 100, l.load[2] % 100, (sort == PTOP_SORT_CPU) ? "cpu" : "mem",
+			interval->tv_sec, interval->tv_nsec / 1000000);
+	bprintf("%7s %2s %6s %9s %14s %4s  %s\n", "PID", "S", "CPU%", "RSS(kB)", "MEMORY", "THR", "COMMAND");
+
+	pid_t fg = tcgetpgrp(0);
+	int64_t page_kb = sysconf(_SC_PAGESIZE) >> 10;
+	uint32_t rows = __ptop_rows();
+	for(uint32_t i=0; i<n && i<rows; i++){
+		ptop_entry *e = live[i];
+		bprintf("%7d %c%c %4ld.%ld %9ld %13luB %4ld  %s\n", e->pid, e->st.state, pinfo_activity(&e->st, fg),
+				e->cpu / 10, e->cpu % 10, e->st.rss * page_kb, e->st.vsize, e->st.num_threads, e->st.comm);
+	}
+	bflush();
+
+	free(perm);
+	free(names);
+	free(keys);
+	free(live);
+}
+
+/**
+ * @brief Live system-wide process table, busiest first
+ * @details Usage: `ptop [-n secs] [-s cpu|mem]`. Refreshes every second by default,
+ * intervals can be fractional. Press `c` / `m` to sort by CPU / memory, `q` to quit.
+ * Per pid state is kept across refreshes, so CPU usage is the delta since the
+ * previous one, and stat fds stay open for long lived pids.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int ptop(Command *c){
+	struct timespec interval = {1, 0};
+	int sort = PTOP_SORT_CPU;
+	for(int i=1; i<=c->argc; i++){
+		string arg = c->argv.arr[i];
+		if(!strcmp(arg, "-n") && i < c->argc){
+			if(string_to_interval(c->argv.arr[++i], &interval) == -1){
+				throw_error(BAD_ARGS); return -1;
+			}
+		}
+		else if(!strcmp(arg, "-s") && i < c->argc){
+			arg = c->argv.arr[++i];
+			if(!strcmp(arg, "cpu")) sort = PTOP_SORT_CPU;
+			else if(!strcmp(arg, "mem")) sort = PTOP_SORT_MEM;
+			else{
+				throw_error(BAD_ARGS); return -1;
+			}
+		}
+		else{
+			throw_error(BAD_ARGS); return -1;
+		}
+	}
+
+	ptop_table t = {0};
+	t.loadfd = procfs_open(0, "loadavg");
+	t.procfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(check_perror("ptop", t.procfd, -1)){
+		__ptop_destroy(&t);
+		return -1;
+	}
+	int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if(check_perror("ptop", tfd, -1)){
+		__ptop_destroy(&t);
+		return -1;
+	}
+	struct itimerspec its = {.it_interval = interval, .it_value = {0, 1}};
+	timerfd_settime(tfd, 0, &its, NULL);
+
+	struct rlimit old;
+	bool raised = (__ptop_fd_budget(&t, &old) == 0);
+	char *buf = check_bad_alloc(malloc(PTOP_DENTS_BUF));
+
+	// Enable raw mode so we can setup a listener for keys
+	enableRawMode();
+	struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {tfd, POLLIN, 0}};
+	while(poll(fds, 2, -1) != -1 || errno == EINTR){
+		char ch;
+		if((fds[0].revents & POLLIN) && read(STDIN_FILENO, &ch, 1) == 1){
+			if(ch == 'q') break;
+			if(ch == 'c' || ch == 'm'){
+				sort = (ch == 'c') ? PTOP_SORT_CPU : PTOP_SORT_MEM;
+				__ptop_print(&t, sort, &interval);
+			}
+		}
+		if(fds[0].revents & (POLLHUP | POLLERR)) break;
+
+		uint64_t ticks;
+		if(!(fds[1].revents & POLLIN) || read(tfd, &ticks, sizeof(ticks)) != sizeof(ticks)) continue;
+		__ptop_refresh(&t, buf);
+		__ptop_print(&t, sort, &interval);
+	}
+
+	// Set terminal back to normal
+	disableRawMode();
+	free(buf);
+	close(tfd);
+	__ptop_destroy(&t);
+	if(raised) setrlimit(RLIMIT_NOFILE, &old);
+	return 0;
+}
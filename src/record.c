@@ -0,0 +1,178 @@
+/**
+ * This is the code for baywatch recordings. A recording is a fixed size
+ * file mapped into memory, holding a header and a ring of fixed width
+ * rows (time followed by one int64 per column, native byte order). The
+ * recorder copies a row into its slot and then bumps the row count, so
+ * appending costs no syscall and readers can tell which rows were
+ * overwritten while they were being read.
+ */
+
+#include "libs.h"
+#include "record.h"
+
+/**
+ * @brief Maps the whole recording file
+ * @return 0 on success, -1 on failure
+ */
+int __record_map(bw_record *r, int prot){
+	r->map = mmap(NULL, r->size, prot, MAP_SHARED, r->fd, 0);
+	if(r->map == MAP_FAILED){
+		r->map = NULL;
+		return -1;
+	}
+	r->hdr = r->map;
+	r->rows = (int64_t*)((char*) r->map + RECORD_HEADER_SIZE);
+	return 0;
+}
+
+/**
+ * @brief Computes the file size of a recording
+ * @return 0 on success, -1 if there are no rows or the size doesn't fit in a size_t
+ */
+int __record_size(uint64_t capacity, uint32_t row_words, size_t *size){
+	uint64_t bytes;
+	if(!capacity || __builtin_mul_overflow(capacity, row_words * sizeof(int64_t), &bytes) ||
+	   __builtin_add_overflow(bytes, RECORD_HEADER_SIZE, &bytes) || bytes > SIZE_MAX) return -1;
+	*size = bytes;
+	return 0;
+}
+
+/**
+ * @brief Creates (or overwrites) a recording for the columns of a sampler
+ * 
+ * @param interval Sampling interval, kept in the header for reference
+ * @param capacity Number of rows kept. Older rows are overwritten.
+ * @return 0 on success, -1 on failure with errno set
+ */
+int record_create(bw_record *r, string path, sampler *s, struct timespec *interval, uint64_t capacity){
+	memset(r, 0, sizeof(bw_record));
+	r->row_words = 1 + s->ncols;
+	r->capacity = capacity;
+	if(__record_size(capacity, r->row_words, &r->size) == -1){
+		errno = EINVAL;
+		return -1;
+	}
+
+	r->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(r->fd == -1) return -1;
+	if(ftruncate(r->fd, r->size) == -1 || __record_map(r, PROT_READ | PROT_WRITE) == -1){
+		int err = errno;
+		close(r->fd);
+		errno = err;
+		return -1;
+	}
+
+	record_header *h = r->hdr;
+	memcpy(h->magic, RECORD_MAGIC, 8);
+	h->version = RECORD_VERSION;
+	h->ncols = s->ncols;
+	h->capacity = capacity;
+	h->interval_ns = interval->tv_sec * 1000000000LL + interval->tv_nsec;
+	h->head = 0;
+	for(uint32_t i=0; i<s->ncols; i++)
+		strcpy(h->cols[i], s->cols[i].header);
+	return 0;
+}
+
+/**
+ * @brief Opens an existing recording read only and checks its header
+ * @details The row count and width are kept from the checked header, the mapped
+ * one may be changed under us by whoever else can write the file.
+ *
+ * @return 0 on success, -1 on failure with errno set
+ */
+int record_open(bw_record *r, string path){
+	memset(r, 0, sizeof(bw_record));
+	r->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(r->fd == -1) return -1;
+
+	struct stat sb;
+	record_header h;
+	size_t size;
+	errno = 0;
+	if(fstat(r->fd, &sb) == -1 || pread(r->fd, &h, sizeof(h), 0) != sizeof(h) ||
+	   memcmp(h.magic, RECORD_MAGIC, 8) || h.version != RECORD_VERSION || h.ncols > METRICS_MAX ||
+	   __record_size(h.capacity, 1 + h.ncols, &size) == -1 || (uint64_t) sb.st_size != size){
+		if(!errno) errno = EINVAL;
+		close(r->fd);
+		return -1;
+	}
+	r->size = size;
+	r->row_words = 1 + h.ncols;
+	r->capacity = h.capacity;
+	if(__record_map(r, PROT_READ) == -1){
+		int err = errno;
+		close(r->fd);
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Appends a row, overwriting the oldest one once the ring is full
+ * @details The row is written before the count is published, so a reader
+ * that sees the new count also sees the whole row. The fence keeps the row from
+ * being overwritten before the previous count is visible, so a reader that copied
+ * part of the new row sees the slot as lapped when it checks the count again.
+ */
+void record_append(bw_record *r, metric_row *row){
+	uint64_t head = r->hdr->head;
+	int64_t *slot = r->rows + (head % r->capacity) * r->row_words;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	slot[0] = row->time_ns;
+	memcpy(slot + 1, row->values, (r->row_words - 1) * sizeof(int64_t));
+	__atomic_store_n(&r->hdr->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Unmaps and closes the recording
+ */
+void record_close(bw_record *r){
+	if(r->map) munmap(r->map, r->size);
+	if(r->fd != -1) close(r->fd);
+	r->map = NULL;
+	r->fd = -1;
+}
+
+/**
+ * @brief Prints every row still in the ring, oldest first, as a table or as CSV
+ * @details The recording may be live. Rows overwritten by the recorder while 
+ * they were being copied are skipped, as is the oldest slot once the ring is full:
+ * it's the one the recorder writes before publishing the next count.
+ * 
+ * @return Number of rows printed. -1 if the header lists an unknown metric.
+ */
+int record_print(bw_record *r, out_buffer *out, bool csv){
+	record_header *h = r->hdr;
+	uint64_t capacity = r->capacity;
+	uint32_t ncols = r->row_words - 1;
+	sampler s;
+	create_sampler(&s);
+	for(uint32_t i=0; i<ncols; i++){
+		char col[METRIC_NAME_MAX];
+		memcpy(col, h->cols[i], METRIC_NAME_MAX);
+		col[METRIC_NAME_MAX-1] = 0;
+		if(sampler_add(&s, col) == -1) return -1;
+	}
+	sampler_print_header(&s, out, csv);
+
+	int printed = 0;
+	uint64_t head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+	uint64_t first = (head > capacity) ? head - capacity : 0;
+	metric_row row;
+	for(uint64_t i=first; i<head; i++){
+		int64_t *slot = r->rows + (i % capacity) * r->row_words;
+		row.time_ns = slot[0];
+		memcpy(row.values, slot + 1, ncols * sizeof(int64_t));
+
+		// The recorder may have lapped us while we copied, or be writing this slot now.
+		// The fence keeps the copy from being read after the count.
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		uint64_t now = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+		if(i + capacity <= now) continue;
+		sampler_print_row(&s, &row, out, csv);
+		printed++;
+	}
+	return printed;
+}
@@ -0,0 +1,375 @@
+/**
+ * This is the code for the command server. `ksh --serve path` sets the shell
+ * up once and listens on a Unix socket. Each connection is handled by a fork
+ * of the warm server, which runs the command lines the client sends with the
+ * regular parser and executor and streams their stdout, stderr and exit
+ * status back. State such as the working directory carries over between the
+ * lines of one connection. `ksh --client path [cmd...]` is the client.
+ */
+
+#include "libs.h"
+#include "server.h"
+
+string srv_path;
+
+// -------------------------------- Framing --------------------------------
+
+/**
+ * @brief Sends all of buf, retrying partial sends
+ * @details MSG_NOSIGNAL: a client that went away must not kill the server with SIGPIPE
+ * @return 0 on success, -1 if the connection is gone
+ */
+int __srv_send_all(int fd, const char *buf, size_t n){
+	while(n){
+		ssize_t sent = send(fd, buf, n, MSG_NOSIGNAL);
+		if(sent == -1){
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		buf += sent;
+		n -= sent;
+	}
+	return 0;
+}
+
+/**
+ * @brief Reads exactly n bytes
+ * @return 1 on success, 0 on end of file, -1 on error
+ */
+int __srv_read_all(int fd, void *buf, size_t n){
+	char *ptr = buf;
+	while(n){
+		ssize_t got = read(fd, ptr, n);
+		if(got == -1 && errno == EINTR) continue;
+		if(got <= 0) return got;
+		ptr += got;
+		n -= got;
+	}
+	return 1;
+}
+
+/**
+ * @brief Sends one message
+ * @return 0 on success, -1 if the connection is gone
+ */
+int __srv_send(int fd, uint32_t type, const void *data, uint32_t len){
+	srv_header h = {type, len};
+	if(__srv_send_all(fd, (char*) &h, sizeof(srv_header)) == -1) return -1;
+	return __srv_send_all(fd, data, len);
+}
+
+/**
+ * @brief Reads one message, growing *buf to fit it. The payload is NUL terminated.
+ * @param max Largest payload accepted
+ * @return 1 on success, 0 on end of file, -1 on error or an oversized message
+ */
+int __srv_recv(int fd, srv_header *h, string *buf, uint32_t *cap, uint32_t max){
+	int ret = __srv_read_all(fd, h, sizeof(srv_header));
+	if(ret != 1) return ret;
+	if(h->len > max) return -1;
+	if(h->len + 1 > *cap){
+		*cap = h->len + 1;
+		*buf = check_bad_alloc(realloc(*buf, *cap));
+	}
+	if(h->len && __srv_read_all(fd, *buf, h->len) != 1) return -1;
+	(*buf)[h->len] = '\0';
+	return 1;
+}
+
+// -------------------------------- Server --------------------------------
+
+/**
+ * @brief Forwarder thread. Sends what the command writes to stdout / stderr until both are closed.
+ * @details Once the client is gone output is still drained, so the command doesn't block on a full pipe.
+ */
+void *__srv_forward(void *arg){
+	srv_stream *s = arg;
+	struct pollfd fds[2] = {{s->out, POLLIN, 0}, {s->err, POLLIN, 0}};
+	uint32_t types[2] = {SRV_OUT, SRV_ERR};
+	int open = 2;
+
+	// Payload is read in right behind a header, so each chunk goes out in one send
+	char *buf = check_bad_alloc(malloc(sizeof(srv_header) + SRV_CHUNK));
+	srv_header *h = (srv_header*) buf;
+	while(open){
+		if(poll(fds, 2, -1) == -1){
+			if(errno == EINTR) continue;
+			break;
+		}
+		for(int i=0; i<2; i++){
+			if(!fds[i].revents) continue;
+			ssize_t n = read(fds[i].fd, buf + sizeof(srv_header), SRV_CHUNK);
+			if(n > 0){
+				h->type = types[i];
+				h->len = n;
+				if(!s->dead && __srv_send_all(s->conn, buf, sizeof(srv_header) + n) == -1) s->dead = true;
+			}
+			else if(n == 0 || errno != EINTR){
+				close(fds[i].fd);
+				fds[i].fd = -1;
+				open--;
+			}
+		}
+	}
+	free(buf);
+	return NULL;
+}
+
+/**
+ * @brief Runs one command line with its stdout / stderr sent to the client, then sends its status
+ * @return 0 on success, -1 if the connection is gone
+ */
+int __srv_run(int conn, string line){
+	int out[2], err[2];
+	if(check_perror("ksh", pipe(out), -1)) return -1;
+	if(check_perror("ksh", pipe(err), -1)){
+		close(out[READ_END]); close(out[WRITE_END]);
+		return -1;
+	}
+	fcntl(out[READ_END], F_SETFD, FD_CLOEXEC);
+	fcntl(err[READ_END], F_SETFD, FD_CLOEXEC);
+
+	// Point stdout / stderr at the pipes for the command's duration
+	int saved_out = dup(STDOUT_FILENO), saved_err = dup(STDERR_FILENO);
+	dup2(out[WRITE_END], STDOUT_FILENO);
+	dup2(err[WRITE_END], STDERR_FILENO);
+	close(out[WRITE_END]);
+	close(err[WRITE_END]);
+
+	srv_stream s = {conn, out[READ_END], err[READ_END], false};
+	pthread_t forwarder;
+	if(pthread_create(&forwarder, NULL, __srv_forward, &s)) throw_fatal_perror("ksh");
+
+	KSH.status = 0;
+	parse(line);
+	bflush();
+	fflush(stdout);
+	fflush(stderr);
+
+	// Dropping the last write ends lets the forwarder see end of file (unless a & job holds them)
+	dup2(saved_out, STDOUT_FILENO);
+	dup2(saved_err, STDERR_FILENO);
+	close(saved_out);
+	close(saved_err);
+	pthread_join(forwarder, NULL);
+
+	int32_t status = KSH.status;
+	if(s.dead) return -1;
+	return __srv_send(conn, SRV_STATUS, &status, sizeof(int32_t));
+}
+
+/**
+ * @brief Serves one connection: runs each command line it sends, in order, until it closes
+ */
+void __srv_connection(int conn){
+	KSH.detach_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	string line = NULL;
+	uint32_t cap = 0;
+	srv_header h;
+	while(__srv_recv(conn, &h, &line, &cap, MAX_COMMAND_LENGTH) == 1){
+		if(h.type != SRV_CMD) continue;
+		if(__srv_run(conn, line) == -1) break;
+	}
+	free(line);
+	close(conn);
+	if(KSH.detach_fd != -1) close(KSH.detach_fd);
+}
+
+/**
+ * @brief Reaps connection processes as they exit
+ */
+void __srv_reap(int SIG, siginfo_t *info, void *f){
+	int saved = errno;
+	while(waitpid(-1, NULL, WNOHANG) > 0);
+	errno = saved;
+}
+
+/**
+ * @brief Removes the socket and exits. Connections being served run to completion.
+ */
+void __srv_stop(int SIG, siginfo_t *info, void *f){
+	unlink(srv_path);
+	_exit(EXIT_SUCCESS);
+}
+
+/**
+ * @brief Creates the listening socket at path
+ * @details A socket file left behind by a server that is no longer running is
+ * replaced, one that a server still accepts on is not. The socket is created
+ * accessible to its owner only.
+ *
+ * @return The socket, -1 on failure
+ */
+int __srv_listen(string path){
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(struct sockaddr_un));
+	addr.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(addr.sun_path)){
+		fprintf(stderr, "ksh: socket path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(check_perror("ksh", fd, -1)) return -1;
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	// No window in which others can connect, whatever the umask
+	mode_t mask = umask(077);
+	int ret = bind(fd, (struct sockaddr*) &addr, sizeof(struct sockaddr_un));
+	if(ret == -1 && errno == EADDRINUSE){
+		int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		bool live = (connect(probe, (struct sockaddr*) &addr, sizeof(struct sockaddr_un)) == 0);
+		close(probe);
+		if(live){
+			fprintf(stderr, "ksh: a server is already listening on %s\n", path);
+			close(fd);
+			return -1;
+		}
+		unlink(path);
+		ret = bind(fd, (struct sockaddr*) &addr, sizeof(struct sockaddr_un));
+	}
+	umask(mask);
+	if(ret != -1) ret = chmod(path, 0600);
+	if(check_perror("ksh", ret, -1) || check_perror("ksh", listen(fd, SRV_BACKLOG), -1)){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * @brief Runs the shell as a command server on the Unix socket at path
+ * @details The state is set up once here instead of on every command: user, home,
+ * caches. Commands get /dev/null as stdin and never take the terminal. Only
+ * processes of the server's own user are served. The server runs until it is
+ * sent SIGINT or SIGTERM, which removes the socket.
+ *
+ * @return Only returns on failure, with EXIT_FAILURE
+ */
+int ksh_serve(string path){
+	init_state();
+	KSH.background = true;
+
+	int null = open("/dev/null", O_RDONLY);
+	if(null != -1){
+		dup2(null, STDIN_FILENO);
+		close(null);
+	}
+
+	int lfd = __srv_listen(path);
+	if(lfd == -1){
+		cleanup_state();
+		return EXIT_FAILURE;
+	}
+	srv_path = path;
+	setup_sighandler(SIGCHLD, __srv_reap);
+	setup_sighandler(SIGINT, __srv_stop);
+	setup_sighandler(SIGTERM, __srv_stop);
+	printf("ksh: serving on %s\n", path);
+	fflush(stdout);
+
+	while(1){
+		int conn = accept(lfd, NULL, NULL);
+		if(conn == -1){
+			if(errno != EINTR && errno != ECONNABORTED) check_perror("ksh", -1, -1);
+			continue;
+		}
+		fcntl(conn, F_SETFD, FD_CLOEXEC);
+
+		// Connecting means running commands as us, the socket's mode is not the only check
+		srv_peer peer;
+		socklen_t len = sizeof(srv_peer);
+		int known = getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &peer, &len);
+		if(known == -1 || peer.uid != getuid()){
+			if(known != -1) fprintf(stderr, "ksh: refused connection from uid %d\n", peer.uid);
+			close(conn);
+			continue;
+		}
+
+		pid_t pid = fork();
+		if(ISCHILD(pid)){
+			close(lfd);
+			signal(SIGCHLD, SIG_DFL);
+			signal(SIGINT, SIG_DFL);
+			signal(SIGTERM, SIG_DFL);
+			__srv_connection(conn);
+			_exit(EXIT_SUCCESS);
+		}
+		check_error(FORK_FAIL, pid, -1);
+		close(conn);
+	}
+}
+
+// -------------------------------- Client --------------------------------
+
+/**
+ * @brief Sends a command line and copies the reply to stdout / stderr
+ * @param status Set to the command's status
+ * @return 0 on success, -1 if the connection was lost
+ */
+int __client_run(int fd, string line, string *buf, uint32_t *cap, int32_t *status){
+	if(__srv_send(fd, SRV_CMD, line, strlen(line)) == -1) return -1;
+	srv_header h;
+	while(__srv_recv(fd, &h, buf, cap, SRV_CHUNK) == 1){
+		if(h.type == SRV_OUT) write(STDOUT_FILENO, *buf, h.len);
+		else if(h.type == SRV_ERR) write(STDERR_FILENO, *buf, h.len);
+		else if(h.type == SRV_STATUS && h.len == sizeof(int32_t)){
+			memcpy(status, *buf, sizeof(int32_t));
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Runs command lines on the server listening at path
+ * @details Usage: `ksh --client path cmd...` runs the one line made of the arguments.
+ * Without arguments, every line read from stdin is run in turn on one connection.
+ *
+ * @return The status of the last command as an exit code, 255 if it failed or the
+ * server could not be reached
+ */
+int ksh_client(string path, int argc, char *argv[]){
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(struct sockaddr_un));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(check_perror("ksh", fd, -1)) return 255;
+	if(connect(fd, (struct sockaddr*) &addr, sizeof(struct sockaddr_un)) == -1){
+		perror(path);
+		return 255;
+	}
+
+	string buf = NULL;
+	uint32_t cap = 0;
+	int32_t status = 0;
+	int ret = 0;
+	if(argc){
+		size_t len = 0;
+		for(int i=0; i<argc; i++) len += strlen(argv[i]) + 1;
+		string line = check_bad_alloc(calloc(len, sizeof(char)));
+		for(int i=0; i<argc; i++){
+			if(i) strcat(line, " ");
+			strcat(line, argv[i]);
+		}
+		ret = __client_run(fd, line, &buf, &cap, &status);
+		free(line);
+	}
+	else{
+		string line = NULL;
+		size_t n = 0;
+		ssize_t len;
+		while(ret == 0 && (len = getline(&line, &n, stdin)) != -1){
+			if(len && line[len-1] == '\n') line[len-1] = '\0';
+			ret = __client_run(fd, line, &buf, &cap, &status);
+		}
+		free(line);
+	}
+	if(ret == -1) fprintf(stderr, "ksh: lost the connection to %s\n", path);
+	free(buf);
+	close(fd);
+	return (ret == -1) ? 255 : (status & 0xff);
+}
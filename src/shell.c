@@ -1,10 +1,17 @@
 /**
- * Initialize, keep prompting, cleanup on exit.
+ * Initialize, keep prompting, cleanup on exit. `--serve path` and `--client path`
+ * run the command server and its client instead (see server.h), `--zygote fd`
+ * the zygote (see zygote.h).
  */
 #include "libs.h"
 #include "shell.h"
 
 int main(int argc, char *argv[]){
+	if(argc >= 3 && !strcmp(argv[1], "--serve")) return ksh_serve(argv[2]);
+	if(argc >= 3 && !strcmp(argv[1], "--client")) return ksh_client(argv[2], argc-3, &argv[3]);
+	if(argc >= 3 && !strcmp(argv[1], "--zygote")) return zygote_main(atoi(argv[2]));
+	zygote_exe = "/proc/self/exe";
+
 	init();
     while(prompt());
     cleanup();
@@ -24,6 +24,12 @@ void setup_sighandler(int SIG, void (*handler)(int, siginfo_t*, void*)){
  * @brief Handles receiving ctrl-c signals and ignores them
  */
 void ksh_ctrlc(int SIG, siginfo_t *info, void *){
+
+    // A plugin builtin is running in the shell itself, ask it to stop instead
+    if(KSH.plugins.running){
+        KSH.plugins.cancelled = 1;
+        return;
+    }
     
     write(STDOUT_FILENO, "\n", strlen("\n"));
     __thread_safe_display_prompt();
@@ -59,11 +65,13 @@ void ksh_sigchld(int SIG, siginfo_t *info, void *f){
     bool isBackground = false;
     char buf[4096];
 
-    // Reap all children zombie processes & output info about suspended processes as well
+    // Reap all children zombie processes & output info about suspended processes as well.
+    // Processes that aren't jobs (timer runs) are reaped silently.
     while ((c_pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) > 0) {
 
     	// Get name from global linked list
         string process_name = get_process_name(c_pid, &(KSH.plist.head));
+        if(!process_name) continue;
         isBackground = true; // Set flag to true
 
         // Handle all R->S states as expected
@@ -83,8 +91,8 @@ void ksh_sigchld(int SIG, siginfo_t *info, void *f){
     // Output prompt again only if interrupted by background process SIGCHLD
     if(isBackground){
    	    __thread_safe_display_prompt();
+        getline_pt = 0;
+        if(getline_inp)
+            memset(getline_inp, 0, MAX_COMMAND_LENGTH);
     }
-    getline_pt = 0;
-    if(getline_inp)
-        memset(getline_inp, 0, MAX_COMMAND_LENGTH);
 }
\ No newline at end of file
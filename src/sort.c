@@ -0,0 +1,259 @@
+/**
+ * This is the code for sorting listings of names. Every name is case folded
+ * once into a key arena, so comparisons are plain byte compares. Large inputs
+ * are sorted with an MSD radix sort over the folded keys whose top level
+ * buckets are spread over the worker pool. Small inputs (and sorts on a
+ * numeric key) use an introsort. Sorting produces a permutation, the caller
+ * reorders its own arrays with it.
+ */
+
+#include "libs.h"
+#include "sort.h"
+
+typedef struct sort_rec{
+	int64_t primary;
+	const unsigned char *key;
+	const char *name;
+	uint32_t idx;
+} sort_rec;
+
+/**
+ * @brief Record order: primary key descending, then folded key, then the original
+ * name and position so the result is deterministic.
+ */
+int __rec_cmp(const sort_rec *a, const sort_rec *b){
+	if(a->primary != b->primary) return (a->primary > b->primary) ? -1 : 1;
+	int ret = strcmp((const char*) a->key, (const char*) b->key);
+	if(ret) return ret;
+	if(a->key != (const unsigned char*) a->name && (ret = strcmp(a->name, b->name))) return ret;
+	return (a->idx > b->idx) - (a->idx < b->idx);
+}
+
+void __swap_rec(sort_rec *a, sort_rec *b){
+	sort_rec tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+void __insertion_sort(sort_rec *r, uint32_t n){
+	for(uint32_t i=1; i<n; i++){
+		sort_rec cur = r[i];
+		uint32_t j = i;
+		for(; j > 0 && __rec_cmp(&cur, &r[j-1]) < 0; j--) r[j] = r[j-1];
+		r[j] = cur;
+	}
+}
+
+void __sift_down(sort_rec *r, uint32_t root, uint32_t n){
+	for(uint32_t child; (child = 2*root + 1) < n; root = child){
+		if(child + 1 < n && __rec_cmp(&r[child], &r[child+1]) < 0) child++;
+		if(__rec_cmp(&r[root], &r[child]) >= 0) return;
+		__swap_rec(&r[root], &r[child]);
+	}
+}
+
+void __heap_sort(sort_rec *r, uint32_t n){
+	for(uint32_t i = n/2; i-- > 0;) __sift_down(r, i, n);
+	for(uint32_t i = n; i-- > 1;){
+		__swap_rec(&r[0], &r[i]);
+		__sift_down(r, 0, i);
+	}
+}
+
+/**
+ * @brief Quicksort with median of 3 pivots. Falls back to heapsort once the
+ * recursion gets too deep and to insertion sort for small partitions.
+ */
+void __introsort(sort_rec *r, uint32_t n, int depth){
+	while(n > INSERTION_SORT_MAX){
+		if(depth-- == 0){
+			__heap_sort(r, n);
+			return;
+		}
+
+		// Median of 3, moved to r[0]
+		uint32_t mid = n/2;
+		if(__rec_cmp(&r[mid], &r[0]) < 0) __swap_rec(&r[mid], &r[0]);
+		if(__rec_cmp(&r[n-1], &r[0]) < 0) __swap_rec(&r[n-1], &r[0]);
+		if(__rec_cmp(&r[n-1], &r[mid]) < 0) __swap_rec(&r[n-1], &r[mid]);
+		__swap_rec(&r[0], &r[mid]);
+
+		// Hoare partition around r[0]
+		uint32_t i = 0, j = n;
+		while(1){
+			while(__rec_cmp(&r[++i], &r[0]) < 0 && i < n-1);
+			while(__rec_cmp(&r[0], &r[--j]) < 0);
+			if(i >= j) break;
+			__swap_rec(&r[i], &r[j]);
+		}
+		__swap_rec(&r[0], &r[j]);
+
+		// Recurse into the smaller half, loop on the larger
+		if(j < n - j - 1){
+			__introsort(r, j, depth);
+			r += j + 1; n -= j + 1;
+		}
+		else{
+			__introsort(r + j + 1, n - j - 1, depth);
+			n = j;
+		}
+	}
+	__insertion_sort(r, n);
+}
+
+void __sort_small(sort_rec *r, uint32_t n){
+	int depth = 0;
+	for(uint32_t m = n; m; m >>= 1) depth += 2;
+	__introsort(r, n, depth);
+}
+
+/**
+ * @brief MSD radix sort on byte d of the folded keys, using tmp as scratch.
+ * @details All records must share their first d bytes. Keys ending at byte d 
+ * are equal so far and are ordered by the tie breaks of __rec_cmp.
+ */
+void __radix_sort(sort_rec *r, sort_rec *tmp, uint32_t n, uint32_t d){
+	if(n < RADIX_SORT_MIN/16){
+		__sort_small(r, n);
+		return;
+	}
+
+	uint32_t count[257] = {0};
+	for(uint32_t i=0; i<n; i++) count[r[i].key[d] + 1]++;
+	for(int b=1; b<=256; b++) count[b] += count[b-1];
+
+	uint32_t pos[256];
+	memcpy(pos, count, sizeof(pos));
+	for(uint32_t i=0; i<n; i++) tmp[pos[r[i].key[d]]++] = r[i];
+	memcpy(r, tmp, n * sizeof(sort_rec));
+
+	// Bucket 0 holds the keys that ended, they only differ in tie breaks
+	__sort_small(r, count[1]);
+	for(int b=1; b<256; b++)
+		__radix_sort(r + count[b], tmp + count[b], count[b+1] - count[b], d+1);
+}
+
+typedef struct radix_job{
+	sort_rec *r;
+	sort_rec *tmp;
+	uint32_t count[257];
+} radix_job;
+
+/**
+ * @brief Worker sorting top level radix buckets [begin, end)
+ */
+void __radix_buckets(void *arg, uint32_t begin, uint32_t end){
+	radix_job *job = arg;
+	for(uint32_t b=begin; b<end; b++){
+		uint32_t lo = job->count[b], hi = job->count[b+1];
+		if(!b) __sort_small(job->r + lo, hi - lo);
+		else __radix_sort(job->r + lo, job->tmp + lo, hi - lo, 1);
+	}
+}
+
+/**
+ * @brief Radix sort whose first level of buckets is sorted by the worker pool
+ */
+void __parallel_radix_sort(sort_rec *r, uint32_t n){
+	sort_rec *tmp = check_bad_alloc(malloc(n * sizeof(sort_rec)));
+	radix_job job = {r, tmp, {0}};
+
+	for(uint32_t i=0; i<n; i++) job.count[r[i].key[0] + 1]++;
+	for(int b=1; b<=256; b++) job.count[b] += job.count[b-1];
+
+	uint32_t pos[256];
+	memcpy(pos, job.count, sizeof(pos));
+	for(uint32_t i=0; i<n; i++) tmp[pos[r[i].key[0]]++] = r[i];
+	memcpy(r, tmp, n * sizeof(sort_rec));
+
+	parallel_for(256, 1, __radix_buckets, &job);
+	free(tmp);
+}
+
+/**
+ * @brief Builds the sort records. Names are case folded once into a single arena.
+ * @return The arena (NULL if names are used as keys directly). Caller must free.
+ */
+unsigned char* __build_records(sort_rec *r, string *names, const int64_t *keys, uint32_t n, bool casesens){
+	unsigned char *arena = NULL;
+	if(!casesens){
+		size_t total = 0;
+		for(uint32_t i=0; i<n; i++) total += strlen(names[i]) + 1;
+		arena = check_bad_alloc(malloc(max(total, 1)));
+	}
+
+	unsigned char *ptr = arena;
+	for(uint32_t i=0; i<n; i++){
+		r[i].primary = (keys) ? keys[i] : 0;
+		r[i].name = names[i];
+		r[i].idx = i;
+		if(casesens){
+			r[i].key = (const unsigned char*) names[i];
+			continue;
+		}
+		r[i].key = ptr;
+		for(const char *s = names[i]; *s; s++) *ptr++ = tolower((unsigned char) *s);
+		*ptr++ = '\0';
+	}
+	return arena;
+}
+
+/**
+ * @brief Extracts the permutation from sorted records
+ */
+uint32_t* __to_permutation(sort_rec *r, uint32_t n){
+	uint32_t *perm = check_bad_alloc(malloc(max(n, 1) * sizeof(uint32_t)));
+	for(uint32_t i=0; i<n; i++) perm[i] = r[i].idx;
+	return perm;
+}
+
+/**
+ * @brief Sorts names
+ * 
+ * @param casesens If false names are compared case insensitively
+ * @return perm where perm[i] is the index of the i-th name in sorted order. Caller must free.
+ */
+uint32_t* sort_names(string *names, uint32_t n, bool casesens){
+	sort_rec *r = check_bad_alloc(malloc(max(n, 1) * sizeof(sort_rec)));
+	unsigned char *arena = __build_records(r, names, NULL, n, casesens);
+
+	if(n >= RADIX_SORT_MIN) __parallel_radix_sort(r, n);
+	else __sort_small(r, n);
+
+	uint32_t *perm = __to_permutation(r, n);
+	free(arena);
+	free(r);
+	return perm;
+}
+
+/**
+ * @brief Sorts names by a numeric key, largest first. Ties are broken by the 
+ * case insensitive name.
+ * 
+ * @return perm where perm[i] is the index of the i-th name in sorted order. Caller must free.
+ */
+uint32_t* sort_by_key(string *names, const int64_t *keys, uint32_t n){
+	sort_rec *r = check_bad_alloc(malloc(max(n, 1) * sizeof(sort_rec)));
+	unsigned char *arena = __build_records(r, names, keys, n, false);
+
+	__sort_small(r, n);
+
+	uint32_t *perm = __to_permutation(r, n);
+	free(arena);
+	free(r);
+	return perm;
+}
+
+/**
+ * @brief Reorders arr so that arr[i] becomes arr[perm[i]]
+ * 
+ * @param arr Array of n elements, elem_size bytes each
+ */
+void apply_permutation(void *arr, size_t elem_size, const uint32_t *perm, uint32_t n){
+	if(n < 2) return;
+	char *src = check_bad_alloc(malloc(n * elem_size));
+	memcpy(src, arr, n * elem_size);
+	for(uint32_t i=0; i<n; i++)
+		memcpy((char*) arr + i*elem_size, src + perm[i]*elem_size, elem_size);
+	free(src);
+}
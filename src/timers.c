@@ -0,0 +1,443 @@
+/**
+ * This is the code for timers: shell commands run periodically (every) or
+ * once (at). Tasks live in a hierarchical timer wheel of TIMER_LEVELS levels
+ * of TIMER_SLOTS slots, each level covering TIMER_SLOTS times the span of the
+ * one below it. Insert and cancel are O(1) list operations; a task is moved
+ * down a level when the level below it wraps around. A timerfd is armed for
+ * the next slot that has work, the prompt polls it while it waits for input.
+ */
+
+#include "libs.h"
+#include "timers.h"
+
+#define TIMER_MASK (TIMER_SLOTS - 1)
+
+// -------------------------------- Wheel --------------------------------
+
+int64_t __timer_clock_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief The tick the monotonic clock is in right now
+ */
+int64_t __timer_current(timer_wheel *w){
+	return (__timer_clock_ns() - w->base_ns) / TIMER_TICK_NS;
+}
+
+/**
+ * @brief Puts a task in the slot its expiry falls in, relative to the current tick
+ * @details Tasks due within TIMER_SLOTS ticks go in level 0, within TIMER_SLOTS^2
+ * in level 1 and so on. Overdue tasks go in the slot processed next, tasks past
+ * the span of the wheel in the last level, from where they are placed again.
+ */
+void __timer_link(timer_wheel *w, timer_task *t){
+	int64_t at = t->expires, delta = t->expires - w->now;
+	if(delta < 0){
+		at = w->now;
+		delta = 0;
+	}
+	if(delta >= TIMER_SPAN){
+		at = w->now + TIMER_SPAN - 1;
+		delta = TIMER_SPAN - 1;
+	}
+	int level = 0;
+	while(level < TIMER_LEVELS - 1 && delta >= (1LL << (TIMER_BITS * (level + 1)))) level++;
+
+	t->level = level;
+	t->slot = (at >> (TIMER_BITS * level)) & TIMER_MASK;
+	timer_task **head = &w->slots[level][t->slot];
+	t->prev = NULL;
+	t->next = *head;
+	if(*head) (*head)->prev = t;
+	*head = t;
+	w->occupied[level] |= 1ULL << t->slot;
+}
+
+void __timer_unlink(timer_wheel *w, timer_task *t){
+	timer_task **head = &w->slots[t->level][t->slot];
+	if(t->prev) t->prev->next = t->next;
+	else *head = t->next;
+	if(t->next) t->next->prev = t->prev;
+	if(!*head) w->occupied[t->level] &= ~(1ULL << t->slot);
+	t->prev = t->next = NULL;
+}
+
+/**
+ * @brief Detaches the list of tasks in a slot
+ */
+timer_task* __timer_take(timer_wheel *w, int level, int slot){
+	timer_task *list = w->slots[level][slot];
+	w->slots[level][slot] = NULL;
+	w->occupied[level] &= ~(1ULL << slot);
+	return list;
+}
+
+/**
+ * @brief Moves the tasks of the current slot of a level down into the levels below it
+ * @return The index of the slot, 0 when this level wrapped around as well
+ */
+int __timer_cascade(timer_wheel *w, int level){
+	int slot = (w->now >> (TIMER_BITS * level)) & TIMER_MASK;
+	for(timer_task *t = __timer_take(w, level, slot), *next; t; t = next){
+		next = t->next;
+		__timer_link(w, t);
+	}
+	return slot;
+}
+
+/**
+ * @brief The next tick with work: a level 0 slot with tasks, or the wrap around
+ * of a lower level that cascades a non empty slot of a higher one
+ *
+ * @return The tick, -1 if there are no tasks
+ */
+int64_t __timer_next(timer_wheel *w){
+	int64_t best = -1;
+	for(int level = 0; level < TIMER_LEVELS; level++){
+		uint64_t m = w->occupied[level];
+		if(!m) continue;
+
+		// Slots of this level are processed on multiples of unit, starting from the next one
+		int shift = TIMER_BITS * level;
+		int64_t unit = 1LL << shift;
+		int64_t first = (w->now + unit - 1) & ~(unit - 1);
+		int j = (first >> shift) & TIMER_MASK;
+		if(j) m = (m >> j) | (m << (TIMER_SLOTS - j));
+		int64_t at = first + __builtin_ctzll(m) * unit;
+		if(best == -1 || at < best) best = at;
+	}
+	return best;
+}
+
+/**
+ * @brief Arms the timerfd for the next tick with work, disarms it if there is none
+ */
+void __timer_arm(timer_wheel *w){
+	if(w->tfd == -1) return;
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+	int64_t next = __timer_next(w);
+	if(next != -1){
+		int64_t ns = w->base_ns + next * TIMER_TICK_NS;
+		its.it_value.tv_sec = ns / 1000000000LL;
+		its.it_value.tv_nsec = (ns % 1000000000LL) ? ns % 1000000000LL : 1;
+	}
+	timerfd_settime(w->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/**
+ * @brief Frees a task and its id. Trailing free ids are dropped from the table.
+ */
+void __timer_free(timer_wheel *w, timer_task *t){
+	w->tasks[t->id - 1] = NULL;
+	while(w->ntasks && !w->tasks[w->ntasks - 1]) w->ntasks--;
+	w->count--;
+	free(t->cmd);
+	free(t);
+}
+
+/**
+ * @brief Runs a task in a forked subshell, unless its previous run is still alive
+ * @details The subshell leads its own process group, but the commands it runs get
+ * groups of their own (as at the prompt), so a run counts as alive for as long as
+ * the subshell is: until its foreground commands are done, not its `&` ones. It
+ * isn't a job: it's not in the job table and the SIGCHLD handler reaps it silently.
+ */
+void __timer_spawn(timer_task *t){
+	if(t->pid > 0 && kill(-t->pid, 0) == 0){
+		t->skipped++;
+		return;
+	}
+
+	bflush();
+	pid_t pid = fork();
+	if(check_perror("timers", pid, -1)) return;
+	if(ISCHILD(pid)){
+		setpgid(0, 0);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTSTP, SIG_DFL);
+		signal(SIGCHLD, SIG_DFL);
+		KSH.background = true;
+		parse(check_bad_alloc(strdup(t->cmd)));
+		bflush();
+		// Leave without cleanup(), the history and baywatch belong to the shell
+		_exit(EXIT_SUCCESS);
+	}
+	setpgid(pid, pid);
+	t->pid = pid;
+	t->runs++;
+}
+
+/**
+ * @brief Fires the tasks of the current level 0 slot after cascading the levels
+ * that wrap around on this tick. Periodic tasks are placed again.
+ */
+void __timer_tick(timer_wheel *w){
+	int slot = w->now & TIMER_MASK;
+	for(int level = 1; !slot && level < TIMER_LEVELS; level++)
+		slot = __timer_cascade(w, level);
+
+	for(timer_task *t = __timer_take(w, 0, w->now & TIMER_MASK), *next; t; t = next){
+		next = t->next;
+		__timer_spawn(t);
+		if(!t->period){
+			__timer_free(w, t);
+			continue;
+		}
+
+		// Periods missed while the shell was busy are skipped, not run back to back
+		t->expires += t->period;
+		int64_t cur = __timer_current(w);
+		if(t->expires <= cur){
+			int64_t missed = (cur - t->expires) / t->period + 1;
+			t->expires += missed * t->period;
+			t->skipped += missed;
+		}
+		__timer_link(w, t);
+	}
+}
+
+// -------------------------------- API --------------------------------
+
+void create_wheel(timer_wheel *w){
+	memset(w, 0, sizeof(timer_wheel));
+	w->base_ns = __timer_clock_ns();
+	w->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+}
+
+void destroy_wheel(timer_wheel *w){
+	for(uint32_t i=w->ntasks; i-- > 0;)
+		if(w->tasks[i]) __timer_free(w, w->tasks[i]);
+	free(w->tasks);
+	if(w->tfd != -1) close(w->tfd);
+	w->tasks = NULL;
+	w->tfd = -1;
+}
+
+/**
+ * @brief Schedules cmd to run after delay_ns, and then every period_ns if it isn't 0
+ * @details The task gets the lowest free id, so the table stays as long as the
+ * largest id in use.
+ *
+ * @return The task, NULL if timers are unavailable (no timerfd)
+ */
+timer_task* timer_add(timer_wheel *w, int64_t delay_ns, int64_t period_ns, string cmd){
+	if(w->tfd == -1) return NULL;
+	uint32_t id = 1;
+	while(id <= w->ntasks && w->tasks[id - 1]) id++;
+	if(id > w->ntasks){
+		if(w->ntasks == w->cap){
+			w->cap = w->cap ? w->cap * 2 : 16;
+			w->tasks = check_bad_alloc(realloc(w->tasks, w->cap * sizeof(timer_task*)));
+		}
+		w->ntasks++;
+	}
+
+	timer_task *t = check_bad_alloc(calloc(1, sizeof(timer_task)));
+	t->id = id;
+	t->cmd = check_bad_alloc(strdup(cmd));
+	t->expires = __timer_current(w) + (delay_ns + TIMER_TICK_NS - 1) / TIMER_TICK_NS;
+	t->period = period_ns ? (period_ns + TIMER_TICK_NS - 1) / TIMER_TICK_NS : 0;
+	w->tasks[t->id - 1] = t;
+	w->count++;
+	__timer_link(w, t);
+	__timer_arm(w);
+	return t;
+}
+
+/**
+ * @brief Cancels a task. A run in progress is left alone.
+ * @return 0 on success, -1 if there is no task with this id
+ */
+int timer_cancel(timer_wheel *w, uint32_t id){
+	if(!id || id > w->ntasks || !w->tasks[id - 1]) return -1;
+	timer_task *t = w->tasks[id - 1];
+	__timer_unlink(w, t);
+	__timer_free(w, t);
+	__timer_arm(w);
+	return 0;
+}
+
+/**
+ * @brief Processes every tick with work up to the current one and re-arms the timerfd
+ * @details Called when the timerfd is readable. Ticks without work are skipped over.
+ */
+void timers_run(timer_wheel *w){
+	uint64_t expirations;
+	if(w->tfd == -1) return;
+	read(w->tfd, &expirations, sizeof(expirations));
+
+	int64_t cur = __timer_current(w), next;
+	while((next = __timer_next(w)) != -1 && next <= cur){
+		w->now = next;
+		__timer_tick(w);
+		w->now++;
+	}
+	if(w->now <= cur) w->now = cur + 1;
+	__timer_arm(w);
+}
+
+// -------------------------------- Builtins --------------------------------
+
+/**
+ * @brief Parses a duration: a (fractional) number with an optional ms, s, m, h or d suffix
+ * @return 0 on success, -1 on failure
+ */
+int __timer_duration(string str, int64_t *ns){
+	char num[64];
+	size_t len = strlen(str), n = len;
+	while(n && isalpha(str[n - 1])) n--;
+	if(!n || n >= sizeof(num)) return -1;
+	memcpy(num, str, n);
+	num[n] = '\0';
+
+	int64_t unit;
+	string suffix = str + n;
+	if(!*suffix || !strcmp(suffix, "s")) unit = 1000000000LL;
+	else if(!strcmp(suffix, "ms")) unit = 1000000LL;
+	else if(!strcmp(suffix, "m")) unit = 60 * 1000000000LL;
+	else if(!strcmp(suffix, "h")) unit = 3600 * 1000000000LL;
+	else if(!strcmp(suffix, "d")) unit = 86400 * 1000000000LL;
+	else return -1;
+
+	struct timespec ts;
+	if(string_to_interval(num, &ts) == -1 || ts.tv_sec > INT64_MAX / unit) return -1;
+	*ns = ts.tv_sec * unit + (int64_t) ((__int128) ts.tv_nsec * unit / 1000000000LL);
+	return (*ns < TIMER_TICK_NS) ? -1 : 0;
+}
+
+/**
+ * @brief Nanoseconds from now until the next HH:MM[:SS] local time
+ * @return 0 on success, -1 if str isn't a time of day
+ */
+int __timer_until(string str, int64_t *ns){
+	int h, m, s = 0, used = 0;
+	if((sscanf(str, "%d:%d%n", &h, &m, &used) != 2 || str[used]) &&
+	   (sscanf(str, "%d:%d:%d%n", &h, &m, &s, &used) != 3 || str[used]))
+		return -1;
+	if(h < 0 || h > 23 || m < 0 || m > 59 || s < 0 || s > 59) return -1;
+
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	struct tm tm;
+	localtime_r(&now.tv_sec, &tm);
+	tm.tm_hour = h;
+	tm.tm_min = m;
+	tm.tm_sec = s;
+	tm.tm_isdst = -1;
+	time_t at = mktime(&tm);
+	if(at <= now.tv_sec){
+		tm.tm_mday++;
+		tm.tm_isdst = -1;
+		at = mktime(&tm);
+	}
+	*ns = (at - now.tv_sec) * 1000000000LL - now.tv_nsec;
+	return 0;
+}
+
+/**
+ * @brief Schedules the command after the when argument of every / at
+ * @details Timers fire while the prompt waits for input, so a shell without one
+ * (a server connection, an embedded shell, a subshell) refuses them.
+ */
+int __timer_schedule(Command *c, int64_t delay_ns, int64_t period_ns){
+	if(KSH.background){
+		bprintf("%s: timers only run in the interactive shell\n", c->name);
+		return -1;
+	}
+	string cmd = rebuild_command(c, 2);
+	timer_task *t = timer_add(&KSH.timers, delay_ns, period_ns, cmd);
+	free(cmd);
+	if(!t){
+		bprintf("Timers are unavailable, timerfd_create failed at startup.\n");
+		return -1;
+	}
+	bprintf("[%u]\n", t->id);
+	return 0;
+}
+
+/**
+ * @brief Runs a command periodically
+ * @details Usage: `every <interval> command...`, ex. `every 5s echo hi`. Intervals
+ * take an ms, s, m, h or d suffix (default s). Runs while the previous one is still
+ * going are skipped. Prints the timer id, see `timers`.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int every(Command *c){
+	int64_t period;
+	if(c->argc < 2){
+		throw_error(TOO_LESS_ARGS); return -1;
+	}
+	if(__timer_duration(c->argv.arr[1], &period) == -1){
+		throw_error(BAD_ARGS); return -1;
+	}
+	return __timer_schedule(c, period, period);
+}
+
+/**
+ * @brief Runs a command once, later
+ * @details Usage: `at +<delay> command...` or `at HH:MM[:SS] command...`, ex.
+ * `at +10m make`. A time of day is its next occurrence. Prints the timer id.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int at(Command *c){
+	int64_t delay;
+	if(c->argc < 2){
+		throw_error(TOO_LESS_ARGS); return -1;
+	}
+	string when = c->argv.arr[1];
+	if(when[0] == '+' ? __timer_duration(when + 1, &delay) : __timer_until(when, &delay)){
+		throw_error(BAD_ARGS); return -1;
+	}
+	return __timer_schedule(c, delay, 0);
+}
+
+/**
+ * @brief Lists scheduled timers, or cancels them
+ * @details Usage: `timers` lists every task with the time until its next run, its
+ * interval, and how many runs happened / were skipped. `timers -k id...` cancels.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int timers(Command *c){
+	timer_wheel *w = &KSH.timers;
+	if(c->argc && !strcmp(c->argv.arr[1], "-k")){
+		if(c->argc < 2){
+			throw_error(TOO_LESS_ARGS); return -1;
+		}
+		int ret = 0;
+		for(int i=2; i<=c->argc; i++){
+			int64_t id = string_to_int(c->argv.arr[i]);
+			if(id <= 0 || id > UINT32_MAX || timer_cancel(w, id) == -1){
+				bprintf("Timer %s does not exist.\n", c->argv.arr[i]);
+				ret = -1;
+			}
+		}
+		return ret;
+	}
+	if(c->argc){
+		throw_error(BAD_ARGS); return -1;
+	}
+
+	int64_t now_ns = __timer_clock_ns();
+	bprintf("%-6s %10s %10s %8s %8s  %s\n", "ID", "NEXT(s)", "EVERY(s)", "RUNS", "SKIPPED", "COMMAND");
+	for(uint32_t i=0; i<w->ntasks; i++){
+		timer_task *t = w->tasks[i];
+		if(!t) continue;
+		int64_t next = w->base_ns + t->expires * TIMER_TICK_NS - now_ns;
+		if(next < 0) next = 0;
+		char every[32] = "-";
+		if(t->period){
+			int64_t ms = t->period * TIMER_TICK_NS / 1000000;
+			sprintf(every, "%ld.%03ld", ms / 1000, ms % 1000);
+		}
+		bprintf("%-6u %6ld.%03ld %10s %8lu %8lu  %s\n", t->id, next / 1000000000LL, next / 1000000 % 1000, every,
+				t->runs, t->skipped, t->cmd);
+	}
+	return 0;
+}
@@ -18,7 +18,8 @@
 #define clrscr() printf("\e[1;1H\e[2J")
 #endif
 
-Shell KSH;
+Shell ksh_main;
+_Thread_local Shell *ksh_ctx = &ksh_main;
 
 int min(int a, int b) { return (a<b)?a:b; }
 int max(int a, int b) { return (a>b)?a:b; }
@@ -47,6 +48,8 @@ void swapstring(string *a, string *b){
 void make_fg_process(pid_t pid){
     // Give the process its own process group
     setpgid(pid, 0);
+    // A shell running in the background (replay &) must not take the terminal
+    if(KSH.background) return;
     // Ignore SIGTTIN & SIGTTOU so shell doesn't get suspended
     signal(SIGTTIN, SIG_IGN);
     signal(SIGTTOU, SIG_IGN);   
@@ -58,6 +61,7 @@ void make_fg_process(pid_t pid){
  * @brief Makes the calling process the foreground process again
  */
 void make_fg_parent(){
+    if(KSH.background) return;
     // Set parent back to foreground process gid
     tcsetpgrp(STDIN_FILENO, getpgid(0));    
     // Set TTIN & TTOUT handlers back to default
@@ -80,6 +84,32 @@ int64_t string_to_int(string str){
     return num;
 }
 
+/**
+ * @brief Converts a time interval in seconds to a timespec
+ * @details Accepts whole or fractional seconds ("5", "0.05", ".5"), with at most
+ * nanosecond precision. Intervals under a millisecond are rejected.
+ * 
+ * @return 0 on success, -1 if str is not a valid interval
+ */
+int string_to_interval(string str, struct timespec *ts){
+    int64_t sec = 0, nsec = 0, scale = 100000000;
+    char *ptr = str;
+    if(!*ptr) return -1;
+    for(; isdigit(*ptr); ptr++){
+        sec = sec*10 + (*ptr - '0');
+        if(sec > INT32_MAX) return -1;
+    }
+    if(*ptr == '.'){
+        for(ptr++; isdigit(*ptr); ptr++, scale /= 10)
+            nsec += (*ptr - '0') * scale;
+    }
+    if(*ptr || ptr == str || (ptr - str == 1 && *str == '.')) return -1;
+    if(sec == 0 && nsec < MIN_INTERVAL_NS) return -1;
+    ts->tv_sec = sec;
+    ts->tv_nsec = nsec;
+    return 0;
+}
+
 /**
  * @brief Returns a pointer to a string containing cwd
  * @return String: cwd. Caller must free.
@@ -176,14 +206,11 @@ void init_history(){
 }
 
 /**
- * @brief Initializes all global dependencies of the shell
- * @details Clears screen, sets up home directory & sets up history tracking
+ * @brief Fills in the state of the current shell context
+ * @details Everything but what only an interactive shell owns: the terminal,
+ * the history file and the signal handlers.
  */
-void init(){
-	
-	clrscr(); // Clear terminal
-
-    // Fill in all the details of our global shell state variable
+void init_state(){
     KSH.uid = getuid();
     KSH.username = check_bad_alloc(strdup(getpwuid(KSH.uid)->pw_name));
     KSH.hostname = check_bad_alloc(malloc((HOST_NAME_MAX+1)*sizeof(char)));
@@ -193,15 +220,41 @@ void init(){
     KSH.lastdir = get_cwd();
     KSH.promptdir = get_prompt_dir();
     KSH.saved_stdin = KSH.saved_stdout = -1;
+    KSH.detach_fd = -1;
     KSH.stdin = STDIN_FILENO;
     KSH.stdout = STDOUT_FILENO;
     KSH.jobs_spawned = 0;
+    KSH.background = false;
+    KSH.status = 0;
+    memset(&KSH.history, 0, sizeof(History));
+    create_buffer(&KSH.out, STDOUT_FILENO, OUTBUF_SIZE);
+    create_idcache(&KSH.users, 16);
+    create_idcache(&KSH.groups, 16);
+    create_dircache(&KSH.dcache);
+    create_wheel(&KSH.timers);
+    create_plugins(&KSH.plugins);
+    create_zygote(&KSH.zygote);
+
+    // Initialize process list
+    init_proclist(&(KSH.plist));
+}
+
+/**
+ * @brief Initializes all global dependencies of the shell
+ * @details Clears screen, sets up home directory & sets up history tracking
+ */
+void init(){
+	
+	clrscr(); // Clear terminal
+
+    // Fill in all the details of our global shell state variable
+    init_state();
 
     // Initialize history
     init_history();
 
-    // Initialize process list
-    init_proclist(&(KSH.plist));
+    // Launch system commands through a zygote if asked to
+    if(getenv("KSH_ZYGOTE")) zygote_start(&KSH.zygote);
 
     // Setup signal handlers
     setup_sighandler(SIGCHLD, ksh_sigchld);
@@ -233,6 +286,13 @@ void cleanup(){
 
     // Free globally available shell resources
     free(hisfile);
+    cleanup_state();
+}
+
+/**
+ * @brief Frees the state of the current shell context, see init_state
+ */
+void cleanup_state(){
     free(KSH.username);
     free(KSH.hostname);
     free(KSH.homedir);
@@ -240,4 +300,13 @@ void cleanup(){
     free(KSH.lastdir);
     free(KSH.promptdir);
     destroy_proclist(&KSH.plist);
+    bflush();
+    destroy_buffer(&KSH.out);
+    destroy_idcache(&KSH.users);
+    destroy_idcache(&KSH.groups);
+    destroy_dircache(&KSH.dcache);
+    destroy_wheel(&KSH.timers);
+    destroy_plugins(&KSH.plugins);
+    zygote_stop(&KSH.zygote);
+    baywatch_stop();
 }
\ No newline at end of file
@@ -47,7 +47,9 @@ void pop_back(string_vector* v){
     v->size--;
     free(v->arr[v->size]);
 
-    if(v->size <= (v->table_size)>>2)
+    // Shrink at a quarter so push / pop around a boundary doesn't realloc every 
+    // time. Small tables are left alone, they'd only thrash (or shrink to 0).
+    if(v->table_size > VECTOR_MIN_SIZE && v->size <= (v->table_size)>>2)
         vec_resize(v, v->table_size>>1);
 }
 
@@ -72,28 +74,104 @@ void destroy_vector(string_vector *v){
 
 
 /**
- * @brief wrapper around strcasecmp
+ * @brief Sort a string of vectors
+ * @details Only the pointers are moved, see sort.c
+ * 
+ * @param v Pointer to the vector to be sorted
+ * @param casesens Boolean flag for whether the sort should consider case or not
  */
-int case_insensitive_cmpfunc(const void *a, const void *b){
-    return strcasecmp(*(const char **)a, *(const char **)b);
+void vec_sort(string_vector *v, bool casesens){
+    uint32_t *perm = sort_names(v->arr, v->size, casesens);
+    apply_permutation(v->arr, sizeof(string), perm, v->size);
+    free(perm);
 }
 
 /**
- * @brief wrapper around strcmp
+ * @brief Creates an empty pool with room for n strings and the given bytes
  */
-int case_sensitive_cmpfunc(const void *a, const void *b){
-    return strcmp(*(const char **)a, *(const char **)b);
+void create_pool(string_pool *p, uint32_t n, size_t bytes){
+    n = max(n, 1);
+    if(bytes < 64) bytes = 64;
+    p->bytes = check_bad_alloc(malloc(bytes));
+    p->index = check_bad_alloc(malloc(n * sizeof(pool_slot)));
+    p->used = 0;
+    p->cap = bytes;
+    p->size = 0;
+    p->table_size = n;
 }
 
 /**
- * @brief Sort a string of vectors
+ * @brief Frees the arena and the index in one go
+ */
+void destroy_pool(string_pool *p){
+    free(p->bytes);
+    free(p->index);
+    p->bytes = NULL;
+    p->index = NULL;
+    p->used = p->cap = 0;
+    p->size = p->table_size = 0;
+}
+
+/**
+ * @brief Makes sure n more strings totalling bytes characters fit without a realloc
+ * @details Growth is geometric, so reserving is only an optimization.
+ */
+void pool_reserve(string_pool *p, uint32_t n, size_t bytes){
+    if(p->size + n > p->table_size){
+        uint32_t tab_size = max(p->table_size<<1, p->size + n);
+        p->index = check_bad_alloc(realloc(p->index, tab_size * sizeof(pool_slot)));
+        p->table_size = tab_size;
+    }
+    // Each string is stored with its NUL terminator
+    bytes += n;
+    if(p->used + bytes > p->cap){
+        size_t cap = (p->cap<<1 > p->used + bytes) ? p->cap<<1 : p->used + bytes;
+        p->bytes = check_bad_alloc(realloc(p->bytes, cap));
+        p->cap = cap;
+    }
+}
+
+/**
+ * @brief Appends a copy of the first len characters of s
+ * @details Complexity: amortized O(len). No allocation unless the pool is full.
+ */
+void pool_push(string_pool *p, const char *s, uint32_t len){
+    pool_reserve(p, 1, len);
+    memcpy(p->bytes + p->used, s, len);
+    p->bytes[p->used + len] = 0;
+    p->index[p->size++] = (pool_slot){p->used, len};
+    p->used += len + 1;
+}
+
+/**
+ * @brief Empties the pool but keeps its memory for reuse. Never shrinks.
+ */
+void pool_clear(string_pool *p){
+    p->used = 0;
+    p->size = 0;
+}
+
+/**
+ * @brief Returns a freshly alloc'd array of pointers to the strings, in index order
+ * @details Valid until the next pool_push. Used to hand pooled strings to sort.c.
+ */
+string* pool_view(string_pool *p){
+    string *view = check_bad_alloc(malloc(max(p->size, 1) * sizeof(string)));
+    for(uint32_t i=0; i<p->size; i++)
+        view[i] = pool_at(p, i);
+    return view;
+}
+
+/**
+ * @brief Sorts the pool. Only the offset / length index is permuted, the arena 
+ * is not touched.
  * 
- * @param v Pointer to the vector to be sorted
  * @param casesens Boolean flag for whether the sort should consider case or not
  */
-void vec_sort(string_vector *v, bool casesens){
-    if(!casesens)
-        qsort(v->arr, v->size, sizeof(string), case_insensitive_cmpfunc);
-    else
-        qsort(v->arr, v->size, sizeof(string), case_sensitive_cmpfunc);
+void pool_sort(string_pool *p, bool casesens){
+    string *view = pool_view(p);
+    uint32_t *perm = sort_names(view, p->size, casesens);
+    apply_permutation(p->index, sizeof(pool_slot), perm, p->size);
+    free(perm);
+    free(view);
 }
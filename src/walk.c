@@ -0,0 +1,290 @@
+/**
+ * This is the code for a parallel directory tree walker. Directories are 
+ * visited by worker threads which share work through work-stealing deques:
+ * a worker pops the directories it discovered itself LIFO and steals the
+ * oldest ones from other workers when it runs dry. Each visit buffers its
+ * results in its node, and the calling thread consumes the nodes in depth
+ * first order as they complete, so output is deterministic. Workers park
+ * when there is nothing to take or once WALK_LOOKAHEAD visited nodes wait
+ * for the calling thread, which visits the nodes it needs next itself when
+ * no worker got to them (or no worker could be started).
+ */
+
+#include "libs.h"
+#include "walk.h"
+
+typedef struct walk_worker{
+	walker *w;
+	uint32_t id;
+	Shell *ctx;
+} walk_worker;
+
+// -------------------------------- Deque --------------------------------
+
+void __create_deque(walk_deque *q){
+	q->table_size = 64;
+	q->arr = check_bad_alloc(malloc(q->table_size * sizeof(walk_node*)));
+	q->head = q->tail = 0;
+	pthread_mutex_init(&q->lock, NULL);
+}
+
+void __destroy_deque(walk_deque *q){
+	free(q->arr);
+	pthread_mutex_destroy(&q->lock);
+}
+
+/**
+ * @brief Pushes a node onto the bottom of the deque. Only called by the owner.
+ */
+void __deque_push(walk_deque *q, walk_node *node){
+	node->queue = q;
+	pthread_mutex_lock(&q->lock);
+	if(q->tail == q->table_size){
+		// Slide live elements to the front, grow if that doesn't free enough space
+		uint32_t live = q->tail - q->head;
+		memmove(q->arr, q->arr + q->head, live * sizeof(walk_node*));
+		q->head = 0;
+		q->tail = live;
+		if(live * 2 > q->table_size){
+			q->table_size <<= 1;
+			q->arr = check_bad_alloc(realloc(q->arr, q->table_size * sizeof(walk_node*)));
+		}
+	}
+	q->arr[q->tail++] = node;
+	pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * @brief Pops the most recently pushed node. NULL if empty.
+ */
+walk_node* __deque_pop(walk_deque *q){
+	walk_node *node = NULL;
+	pthread_mutex_lock(&q->lock);
+	if(q->tail > q->head) node = q->arr[--q->tail];
+	pthread_mutex_unlock(&q->lock);
+	return node;
+}
+
+/**
+ * @brief Steals the oldest node. NULL if empty.
+ */
+walk_node* __deque_steal(walk_deque *q){
+	walk_node *node = NULL;
+	pthread_mutex_lock(&q->lock);
+	if(q->tail > q->head) node = q->arr[q->head++];
+	pthread_mutex_unlock(&q->lock);
+	return node;
+}
+
+/**
+ * @brief Takes node out of the deque if it's still in it, searching from the bottom
+ * @return true if it was, the caller owns it now
+ */
+bool __deque_remove(walk_deque *q, walk_node *node){
+	bool found = false;
+	pthread_mutex_lock(&q->lock);
+	for(uint32_t i = q->tail; i-- > q->head;){
+		if(q->arr[i] != node) continue;
+		memmove(q->arr + i, q->arr + i + 1, (q->tail - i - 1) * sizeof(walk_node*));
+		q->tail--;
+		found = true;
+		break;
+	}
+	pthread_mutex_unlock(&q->lock);
+	return found;
+}
+
+// -------------------------------- Nodes --------------------------------
+
+/**
+ * @brief Creates a node for the directory name inside parent and appends it to
+ * parent's children. Called by visitors, in the order children should be consumed.
+ */
+walk_node* walk_add_child(walk_node *parent, string name){
+	walk_node *node = check_bad_alloc(calloc(1, sizeof(walk_node)));
+	int plen = strlen(parent->path);
+	node->path = check_bad_alloc(malloc(plen + strlen(name) + 2));
+	strcpy(node->path, parent->path);
+	if(plen && parent->path[plen-1] != '/') strcat(node->path, "/");
+	strcat(node->path, name);
+	node->depth = parent->depth + 1;
+	node->parent = parent;
+	node->fd = -1;
+
+	if(parent->nchildren == parent->children_size){
+		parent->children_size = max(4, parent->children_size << 1);
+		parent->children = check_bad_alloc(realloc(parent->children, parent->children_size * sizeof(walk_node*)));
+	}
+	parent->children[parent->nchildren++] = node;
+	return node;
+}
+
+/**
+ * @brief Frees a node. Its children must have been freed already.
+ */
+void __free_node(walk_node *node){
+	if(node->out.buf) destroy_buffer(&node->out);
+	free(node->children);
+	free(node->path);
+	free(node);
+}
+
+/**
+ * @brief Visits a node taken off a deque and queues its children on own
+ * @details The capture buffer is only allocated once the visitor writes to it.
+ */
+void __visit_node(walker *w, walk_node *node, walk_deque *own){
+	pthread_mutex_lock(&w->lock);
+	w->queued--;
+	pthread_mutex_unlock(&w->lock);
+
+	create_buffer(&node->out, OUTBUF_CAPTURE, 0);
+	w->visit(w, node);
+
+	// Queue children last first, so this thread continues with the first child
+	for(uint32_t i = node->nchildren; i-- > 0;)
+		__deque_push(own, node->children[i]);
+
+	pthread_mutex_lock(&w->lock);
+	w->queued += node->nchildren;
+	w->pending += (int64_t) node->nchildren - 1;
+	w->buffered++;
+	node->done = true;
+	pthread_cond_broadcast(&w->cond);
+	if(node->nchildren || !w->pending) pthread_cond_broadcast(&w->work);
+	pthread_mutex_unlock(&w->lock);
+}
+
+/**
+ * @brief Worker loop. Visits nodes from its own deque, steals when it is empty 
+ * and exits once no node is queued or being visited anywhere.
+ * @details Parks while no node is queued, or while WALK_LOOKAHEAD visited nodes
+ * are waiting for the calling thread.
+ */
+void *__walk_worker(void *arg){
+	walk_worker *self = arg;
+	walker *w = self->w;
+	ksh_ctx = self->ctx;
+	in_parallel = true;
+	walk_deque *own = &w->deques[self->id];
+	uint32_t nqueues = w->nthreads + 1;
+
+	while(1){
+		pthread_mutex_lock(&w->lock);
+		while(w->pending && (w->queued <= 0 || w->buffered >= WALK_LOOKAHEAD))
+			pthread_cond_wait(&w->work, &w->lock);
+		bool finished = !w->pending;
+		pthread_mutex_unlock(&w->lock);
+		if(finished) break;
+
+		walk_node *node = __deque_pop(own);
+		for(uint32_t i=1; !node && i < nqueues; i++)
+			node = __deque_steal(&w->deques[(self->id + i) % nqueues]);
+		if(node) __visit_node(w, node, own);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Blocks until the node has been visited, visiting it on the calling thread
+ * if no worker has taken it yet. The node no longer counts as buffered afterwards.
+ */
+void __wait_node(walker *w, walk_node *node){
+	if(__deque_remove(node->queue, node))
+		__visit_node(w, node, &w->deques[w->nthreads]);
+
+	pthread_mutex_lock(&w->lock);
+	while(!node->done) pthread_cond_wait(&w->cond, &w->lock);
+	if(--w->buffered == WALK_LOOKAHEAD - 1) pthread_cond_broadcast(&w->work);
+	pthread_mutex_unlock(&w->lock);
+}
+
+/**
+ * @brief Walks the trees under roots with w->visit on the worker threads
+ * @details The calling thread consumes the nodes depth first, in the order the
+ * visitor added children. w->pre is called once a node has been visited, w->post
+ * once its whole subtree has been consumed. A node is freed right after w->post, 
+ * and workers stay at most WALK_LOOKAHEAD visited nodes ahead of the calling
+ * thread, so buffered output is bounded whatever the size of the tree. If no
+ * worker can be started the calling thread walks the tree alone.
+ * 
+ * @param roots Paths of the root directories, walked one after the other
+ */
+void walk_tree(walker *w, string *roots, uint32_t n){
+	// One deque per worker, the last one is the calling thread's
+	w->nthreads = num_workers();
+	w->deques = check_bad_alloc(malloc((w->nthreads + 1) * sizeof(walk_deque)));
+	for(uint32_t i=0; i<=w->nthreads; i++) __create_deque(&w->deques[i]);
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	pthread_cond_init(&w->work, NULL);
+
+	// Create the roots and seed the calling thread's deque with them
+	walk_node **nodes = check_bad_alloc(malloc(max(n, 1) * sizeof(walk_node*)));
+	w->pending = w->queued = n;
+	w->buffered = 0;
+	for(uint32_t i=0; i<n; i++){
+		nodes[i] = check_bad_alloc(calloc(1, sizeof(walk_node)));
+		nodes[i]->path = check_bad_alloc(strdup(roots[i]));
+		nodes[i]->fd = -1;
+	}
+	for(uint32_t i=n; i-- > 0;) __deque_push(&w->deques[w->nthreads], nodes[i]);
+
+	walk_worker *workers = check_bad_alloc(malloc(w->nthreads * sizeof(walk_worker)));
+	pthread_t *tids = check_bad_alloc(malloc(w->nthreads * sizeof(pthread_t)));
+	// A walk started from a worker thread doesn't start more threads
+	bool nested = in_parallel;
+	uint32_t spawned = 0;
+	for(; spawned < w->nthreads && !nested; spawned++){
+		workers[spawned] = (walk_worker) {w, spawned, ksh_ctx};
+		if(pthread_create(&tids[spawned], NULL, __walk_worker, &workers[spawned])) break;
+	}
+	// Visits made here run alongside the workers
+	in_parallel = nested || spawned > 0;
+
+	// Depth first consumption. Each stack slot remembers the next child to descend into.
+	uint32_t stack_size = 64, top = 0;
+	walk_node **stack = check_bad_alloc(malloc(stack_size * sizeof(walk_node*)));
+	uint32_t *next = check_bad_alloc(malloc(stack_size * sizeof(uint32_t)));
+	for(uint32_t r=0; r<n; r++){
+		__wait_node(w, nodes[r]);
+		if(w->pre) w->pre(w, nodes[r]);
+		stack[0] = nodes[r]; next[0] = 0; top = 1;
+
+		while(top){
+			walk_node *cur = stack[top-1];
+			if(next[top-1] == cur->nchildren){
+				if(w->post) w->post(w, cur);
+				for(uint32_t i=0; i<cur->nchildren; i++) __free_node(cur->children[i]);
+				cur->nchildren = 0;
+				top--;
+				continue;
+			}
+
+			walk_node *child = cur->children[next[top-1]++];
+			__wait_node(w, child);
+			if(w->pre) w->pre(w, child);
+			if(top == stack_size){
+				stack_size <<= 1;
+				stack = check_bad_alloc(realloc(stack, stack_size * sizeof(walk_node*)));
+				next = check_bad_alloc(realloc(next, stack_size * sizeof(uint32_t)));
+			}
+			stack[top] = child; next[top++] = 0;
+		}
+		__free_node(nodes[r]);
+	}
+
+	// Cleanup
+	in_parallel = nested;
+	for(uint32_t i=0; i<spawned; i++) pthread_join(tids[i], NULL);
+	for(uint32_t i=0; i<=w->nthreads; i++) __destroy_deque(&w->deques[i]);
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->cond);
+	pthread_cond_destroy(&w->work);
+	free(w->deques);
+	free(stack);
+	free(next);
+	free(tids);
+	free(workers);
+	free(nodes);
+}
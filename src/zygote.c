@@ -0,0 +1,377 @@
+/**
+ * This is the code for the zygote: a small helper process that launches
+ * system commands on behalf of the shell. It is a fresh exec of ksh that
+ * never sets up the shell state, so its address space stays a fraction of
+ * the shell's and it has no threads. Launching a command is then a clone of
+ * the zygote instead of a fork of the shell. The shell sends it requests
+ * (process group, umask, launch attributes and argv, with the command's stdin / stdout /
+ * stderr and the shell's working directory attached through SCM_RIGHTS) over a
+ * socketpair. The command is cloned with CLONE_PARENT, so it is the shell's child
+ * and job control works as usual. Resource limits and the environment are the
+ * shell's as of `zygote on`.
+ */
+
+#include "libs.h"
+#include "zygote.h"
+
+// The binary the zygote is exec'd from, set by main. Programs embedding libksh have none.
+string zygote_exe = NULL;
+
+typedef union zygote_ctrl{
+	char buf[CMSG_SPACE(ZYGOTE_FDS * sizeof(int))];
+	struct cmsghdr align;
+} zygote_ctrl;
+
+// -------------------------------- Shell side --------------------------------
+
+void create_zygote(zygote_proc *z){
+	z->pid = -1;
+	z->fd = -1;
+	z->owner = -1;
+	z->launched = 0;
+	z->msg = NULL;
+}
+
+/**
+ * @brief Drops a zygote inherited from the shell this process was forked from
+ * @details Its commands would be cloned as children of that shell (CLONE_PARENT)
+ * where this process can't wait for them, and the socket is that shell's to use.
+ * The zygote itself keeps serving the shell that started it.
+ */
+void __zygote_forget_inherited(zygote_proc *z){
+	if(z->fd == -1 || z->owner == getpid()) return;
+	close(z->fd);
+	free(z->msg);
+	create_zygote(z);
+}
+
+/**
+ * @brief Starts the zygote, if it isn't running
+ * @return 0 on success, -1 on failure
+ */
+int zygote_start(zygote_proc *z){
+	__zygote_forget_inherited(z);
+	if(z->fd != -1) return 0;
+	if(!zygote_exe){
+		bprintf("zygote: only available in the ksh binary\n");
+		return -1;
+	}
+
+	int sv[2];
+	if(check_perror("zygote", socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv), -1)) return -1;
+	fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+	char fd[16];
+	snprintf(fd, sizeof(fd), "%d", sv[1]);
+
+	bflush();
+	fflush(stdout);
+	pid_t pid = fork();
+	if(ISCHILD(pid)){
+		execl(zygote_exe, "ksh", "--zygote", fd, (char*) NULL);
+		_exit(EXIT_FAILURE);
+	}
+	close(sv[1]);
+	if(check_error(FORK_FAIL, pid, -1)){
+		close(sv[0]);
+		return -1;
+	}
+	z->pid = pid;
+	z->fd = sv[0];
+	z->owner = getpid();
+	z->launched = 0;
+	z->msg = check_bad_alloc(malloc(ZYGOTE_MSG_MAX));
+	return 0;
+}
+
+/**
+ * @brief Stops the zygote. Commands it launched are the shell's children and keep running.
+ * @details In a fork of the shell it only lets go of the inherited one.
+ */
+void zygote_stop(zygote_proc *z){
+	__zygote_forget_inherited(z);
+	if(z->fd == -1) return;
+	// It exits once it reads end of file. The SIGCHLD handler may reap it first.
+	close(z->fd);
+	waitpid(z->pid, NULL, 0);
+	free(z->msg);
+	create_zygote(z);
+}
+
+/**
+ * @brief Launches argv through the zygote in process group pgid, with the given launch attributes
+ * @details The command gets the shell's current stdin / stdout / stderr, working
+ * directory and umask, so redirection and pipes must be in place. As with a fork, a command that can't be
+ * exec'd reports it on its stdout and exits with EXEC_FAIL. The zygote is stopped
+ * if it went away.
+ *
+ * @param pgid Process group to join, 0 for a new group led by the command
+ * @param launch Launch attributes, NULL for none
+ * @return pid of the command, 0 if the zygote can't take it (the caller should fork),
+ * always in a fork of the shell that started it
+ */
+pid_t zygote_spawn(zygote_proc *z, char **argv, int argc, pid_t pgid, const launch_attr *launch){
+	__zygote_forget_inherited(z);
+	if(z->fd == -1) return 0;
+
+	zygote_request req;
+	req.pgid = pgid;
+	mode_t mask = umask(0);
+	umask(mask);
+	req.umask = mask;
+	if(launch) req.launch = *launch;
+	else launch_init(&req.launch);
+	size_t len = sizeof(zygote_request);
+	memcpy(z->msg, &req, sizeof(zygote_request));
+	for(int i=0; i<argc; i++){
+		size_t n = strlen(argv[i]) + 1;
+		if(len + n > ZYGOTE_MSG_MAX) return 0;
+		memcpy(z->msg + len, argv[i], n);
+		len += n;
+	}
+
+	// A working directory that can't be opened (no read permission) can't be passed either
+	int cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(cwd == -1) return 0;
+	int fds[ZYGOTE_FDS] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, cwd};
+	zygote_ctrl ctrl;
+	struct iovec iov = {z->msg, len};
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl.buf;
+	msg.msg_controllen = sizeof(ctrl.buf);
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+	ssize_t n;
+	zygote_reply r;
+	while((n = sendmsg(z->fd, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR);
+	close(cwd);
+	// A closed stdin / stdout can't be passed, fork for those
+	if(n == -1 && errno == EBADF) return 0;
+	if(n != -1)
+		while((n = recv(z->fd, &r, sizeof(zygote_reply), 0)) == -1 && errno == EINTR);
+	if(n != sizeof(zygote_reply)){
+		bprintf("zygote: helper is gone, forking instead\n");
+		zygote_stop(z);
+		return 0;
+	}
+	if(r.pid <= 0) return 0;
+
+	setpgid(r.pid, pgid ? pgid : r.pid);
+	z->launched++;
+	return r.pid;
+}
+
+// -------------------------------- Zygote side --------------------------------
+
+/**
+ * @brief Clones the zygote and execs one request in the clone
+ * @param msg The request: a zygote_request, then argv NUL separated
+ * @return pid of the command, -errno on failure
+ */
+pid_t __zygote_launch(char *msg, size_t len, int fds[ZYGOTE_FDS]){
+	zygote_request req;
+	memcpy(&req, msg, sizeof(zygote_request));
+	int argc = 0;
+	for(size_t i=sizeof(zygote_request); i<len; i++)
+		if(!msg[i]) argc++;
+	if(!argc || msg[len-1]) return -EINVAL;
+
+	// argv points into the message
+	char **argv = check_bad_alloc(malloc((argc + 1) * sizeof(char*)));
+	char *ptr = msg + sizeof(zygote_request);
+	for(int i=0; i<argc; i++, ptr += strlen(ptr) + 1) argv[i] = ptr;
+	argv[argc] = NULL;
+
+	// A fork whose parent is the shell rather than the zygote
+	pid_t pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, 0);
+	if(pid == 0){
+		setpgid(0, req.pgid);
+		for(int i=0; i<ZYGOTE_STDIO; i++) dup2(fds[i], i);
+		if(check_perror("zygote: cd", fchdir(fds[ZYGOTE_CWD]), -1)) _exit(EXIT_FAILURE);
+		umask(req.umask);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTSTP, SIG_DFL);
+		signal(SIGQUIT, SIG_DFL);
+		sigset_t none;
+		sigemptyset(&none);
+		sigprocmask(SIG_SETMASK, &none, NULL);
+		if(launch_apply(&req.launch) == -1) _exit(EXIT_FAILURE);
+
+		execvp(argv[0], argv);
+		throw_fatal_error(EXEC_FAIL);
+	}
+	int err = errno;
+	free(argv);
+	return (pid == -1) ? -err : pid;
+}
+
+/**
+ * @brief Main loop of the zygote (`ksh --zygote fd`): serves launch requests until the shell hangs up
+ * @details The zygote keeps out of the shell's way: its own process group, so the
+ * terminal's signals don't reach it, and no shell state.
+ *
+ * @param fd Its end of the socketpair
+ */
+int zygote_main(int fd){
+	signal(SIGINT, SIG_IGN);
+	signal(SIGTSTP, SIG_IGN);
+	signal(SIGQUIT, SIG_IGN);
+	setpgid(0, 0);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	char *buf = check_bad_alloc(malloc(ZYGOTE_MSG_MAX));
+	zygote_ctrl ctrl;
+	while(1){
+		struct iovec iov = {buf, ZYGOTE_MSG_MAX};
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(struct msghdr));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = ctrl.buf;
+		msg.msg_controllen = sizeof(ctrl.buf);
+
+		ssize_t n = recvmsg(fd, &msg, 0);
+		if(n == -1 && errno == EINTR) continue;
+		if(n <= 0) break;
+
+		int fds[ZYGOTE_FDS] = {-1, -1, -1, -1};
+		int nfds = 0;
+		for(struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)){
+			if(cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) continue;
+			nfds = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			memcpy(fds, CMSG_DATA(cm), min(nfds, ZYGOTE_FDS) * sizeof(int));
+		}
+
+		zygote_reply r = {0, EINVAL};
+		if(nfds == ZYGOTE_FDS && n > (ssize_t) sizeof(zygote_request)){
+			for(int i=0; i<ZYGOTE_FDS; i++) fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+			pid_t pid = __zygote_launch(buf, n, fds);
+			r.pid = (pid > 0) ? pid : 0;
+			r.err = (pid > 0) ? 0 : -pid;
+		}
+		for(int i=0; i<min(nfds, ZYGOTE_FDS); i++) close(fds[i]);
+		send(fd, &r, sizeof(zygote_reply), MSG_NOSIGNAL);
+	}
+	free(buf);
+	return 0;
+}
+
+// -------------------------------- Builtin --------------------------------
+
+/**
+ * @brief Returns the resident set size of pid in kB, -1 if it can't be read
+ */
+int64_t __zygote_rss(pid_t pid){
+	proc_status st;
+	int fd = procfs_open(pid, "status");
+	if(fd == -1) return -1;
+	int ret = procfs_read_status(fd, &st, PST_VMRSS);
+	close(fd);
+	return (ret == -1) ? -1 : st.vm_rss;
+}
+
+/**
+ * @brief Launches argv n times by forking the shell and n times through the zygote,
+ * and prints the latency of each (launch until exit, one at a time)
+ * @return 0 on success, -1 on failure
+ */
+int __zygote_bench(zygote_proc *z, Command *c){
+	if(c->argc < 3){
+		throw_error(TOO_LESS_ARGS); return -1;
+	}
+	int64_t n = string_to_int(c->argv.arr[2]);
+	if(n <= 0){
+		throw_error(BAD_ARGS); return -1;
+	}
+
+	Command package;
+	init_command(&package, c->argv.arr[3]);
+	for(int i=4; i<=c->argc; i++){
+		push_back(&(package.argv), c->argv.arr[i]);
+		package.argc++;
+	}
+	push_back(&(package.argv), NULL);
+	if(package.builtin != -1){
+		bprintf("zygote: %s is a builtin\n", package.name);
+		destroy_command(&package);
+		return -1;
+	}
+	bool started = (z->fd == -1);
+	if(started && zygote_start(z) == -1){
+		destroy_command(&package);
+		return -1;
+	}
+	bprintf("rss (kB): shell %ld, zygote %ld\n", __zygote_rss(getpid()), __zygote_rss(z->pid));
+
+	// Reap the launches here, not in the SIGCHLD handler
+	sigset_t mask, old;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, &old);
+
+	const char *labels[2] = {"fork", "zygote"};
+	repeat_stats s;
+	int ret = 0;
+	for(int path=0; path<2 && !ret; path++){
+		memset(&s, 0, sizeof(repeat_stats));
+		int64_t begin = repeat_now_ns();
+		for(int64_t i=0; i<n; i++){
+			int64_t t = repeat_now_ns();
+			pid_t pid = path ? zygote_spawn(z, package.argv.arr, package.argc + 1, 0, NULL) : fork_command(&package, 0);
+			if(pid <= 0){
+				ret = -1;
+				break;
+			}
+			int status;
+			while(waitpid(pid, &status, 0) == -1 && errno == EINTR);
+			repeat_record(&s, repeat_now_ns() - t, WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status), NULL);
+		}
+		bprintf("%s: ", labels[path]);
+		repeat_print_stats(&s, repeat_now_ns() - begin, 1);
+		free(s.wall);
+	}
+
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	if(started) zygote_stop(z);
+	destroy_command(&package);
+	return ret;
+}
+
+/**
+ * @brief Controls the zygote
+ * @details Usage: `zygote on|off` starts or stops it, `zygote status` shows it
+ * along with the memory of the shell and of the zygote. `zygote bench N cmd args...`
+ * compares the launch latency of cmd by forking and through the zygote.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int zygote(Command *c){
+	zygote_proc *z = &KSH.zygote;
+	__zygote_forget_inherited(z);
+	if(c->argc < 1){
+		throw_error(TOO_LESS_ARGS); return -1;
+	}
+	string op = c->argv.arr[1];
+	if(!strcmp(op, "on")) return zygote_start(z);
+	if(!strcmp(op, "off")){
+		zygote_stop(z);
+		return 0;
+	}
+	if(!strcmp(op, "status")){
+		if(z->fd == -1) bprintf("zygote: off\n");
+		else{
+			bprintf("zygote: on, pid %d, %lu launches\n", z->pid, z->launched);
+			bprintf("rss (kB): shell %ld, zygote %ld\n", __zygote_rss(getpid()), __zygote_rss(z->pid));
+		}
+		return 0;
+	}
+	if(!strcmp(op, "bench")) return __zygote_bench(z, c);
+	throw_error(BAD_ARGS);
+	return -1;
+}